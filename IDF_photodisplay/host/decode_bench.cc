@@ -0,0 +1,179 @@
+// decode benchmark for the host build: runs a corpus of jpg / qoi files through
+// ReadJpgBufferInternal(), the same path the loader takes for files read into memory, and reports
+// per image and aggregate throughput. files larger than the jpg file buffer (a full screen qoi
+// is ~600 KB) go through LoadImageJPG() and are streamed from the file like on the device,
+// marked with "s" after the size.
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "image_decoder.h"
+#include "image_loader.h"
+
+#define DEFAULT_REPEATS 10
+
+static bool IsImageFile(const char* path) {
+  const char* dot = strrchr(path, '.');
+  return dot && (strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0 ||
+                 strcasecmp(dot, ".qoi") == 0);
+}
+
+static int32_t FileRead(void* handle, uint8_t* buffer, int32_t length) {
+  return fread(buffer, 1, length, (FILE*)handle);
+}
+
+static bool FileSeek(void* handle, int32_t position) {
+  return fseek((FILE*)handle, position, SEEK_SET) == 0;
+}
+
+static void CollectFiles(const std::string& path, std::vector<std::string>* files) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    fprintf(stderr, "cannot open %s\n", path.c_str());
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    files->push_back(path);
+    return;
+  }
+  DIR* dir = opendir(path.c_str());
+  if (dir == NULL) return;
+  std::vector<std::string> entries;
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') continue;
+    std::string child = path + "/" + entry->d_name;
+    if (stat(child.c_str(), &st) == 0 && (S_ISDIR(st.st_mode) || IsImageFile(entry->d_name))) {
+      entries.push_back(child);
+    }
+  }
+  closedir(dir);
+  std::sort(entries.begin(), entries.end());
+  for (const std::string& entry : entries) CollectFiles(entry, files);
+}
+
+static void Usage() {
+  fprintf(stderr,
+          "usage: decode_bench [-n repeats] [-d decoder] [-g min_mpix_per_s] "
+          "<jpg/qoi file or folder> ...\n"
+          "  -n  decodes per image, the best one counts (default %d)\n"
+          "  -d  jpg decoder, jpegdec or tjpgd (only on the chip), .qoi files always use qoi\n"
+          "  -g  exit with 2 if the aggregate throughput is below this, for a perf gate\n",
+          DEFAULT_REPEATS);
+}
+
+int main(int argc, char** argv) {
+  int repeats = DEFAULT_REPEATS;
+  double gate_mpix_per_s = 0;
+  const char* decoder_name = NULL;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      repeats = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      decoder_name = argv[++i];
+    } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+      gate_mpix_per_s = atof(argv[++i]);
+    } else if (argv[i][0] == '-') {
+      Usage();
+      return 1;
+    } else {
+      CollectFiles(argv[i], &files);
+    }
+  }
+  if (files.empty() || repeats < 1) {
+    Usage();
+    return 1;
+  }
+
+  InitializeImageLoader();
+  if (decoder_name != NULL) {
+    ImageDecoderType type = ImageDecoderTypeFromName(decoder_name);
+    if (type == IMAGE_DECODER_QOI || !SetImageDecoder(type)) {
+      fprintf(stderr, "no jpg decoder %s in this build\n", decoder_name);
+      return 1;
+    }
+  }
+  printf("jpg decoder %s\n", ActiveImageDecoder()->name);
+  uint8_t* file_buffer = GetJpgFileBuffer();
+  uint16_t* frame = (uint16_t*)heap_caps_malloc(JPG_IMAGE_BUFFER_SIZE * 2,
+                                                MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (file_buffer == NULL || frame == NULL) {
+    fprintf(stderr, "the loader has no jpg file buffer (IMAGE_LOADER_STREAM_DECODE)\n");
+    return 1;
+  }
+
+  printf("%-32s %9s %11s %9s %9s %8s %8s\n", "image", "bytes", "size", "best ms", "avg ms",
+         "Mpix/s", "MB/s");
+  int decoded = 0, failed = 0;
+  uint64_t total_pixels = 0, total_bytes = 0;
+  int64_t total_best_us = 0;
+  for (const std::string& path : files) {
+    const char* name = strrchr(path.c_str(), '/') ? strrchr(path.c_str(), '/') + 1 : path.c_str();
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) continue;
+    size_t size = fread(file_buffer, 1, JPG_FILE_BUFFER_SIZE + 1, fp);
+    bool streamed = size > JPG_FILE_BUFFER_SIZE;
+    if (streamed && fseek(fp, 0, SEEK_END) == 0) size = ftell(fp);
+
+    const ImageDecoder* decoder = ImageDecoderForPath(path.c_str());
+    bool opened = size > 0 && (streamed ? fseek(fp, 0, SEEK_SET) == 0 &&
+                                              decoder->open_stream(fp, size, FileRead, FileSeek)
+                                        : decoder->open_memory(file_buffer, size));
+    uint32_t width = opened ? decoder->width() : 0, height = opened ? decoder->height() : 0;
+    if (opened) decoder->close();
+    fclose(fp);
+    if (!opened) {
+      printf("%-32s %8zu%c  cannot be opened by %s\n", name, size, streamed ? 's' : ' ',
+             decoder->name);
+      failed++;
+      continue;
+    }
+
+    int64_t best_us = INT64_MAX, sum_us = 0;
+    bool ok = true;
+    for (int r = 0; r < repeats && ok; r++) {
+      int64_t start_us = esp_timer_get_time();
+      ok = streamed ? LoadImageJPG((char*)path.c_str(), frame)
+                    : ReadJpgBufferInternal(decoder, size, frame);
+      int64_t elapsed_us = esp_timer_get_time() - start_us;
+      if (elapsed_us < best_us) best_us = elapsed_us;
+      sum_us += elapsed_us;
+    }
+    if (!ok) {
+      printf("%-32s %8zu%c %5ux%-5u  decode failed (%s)\n", name, size, streamed ? 's' : ' ',
+             width, height, decoder->name);
+      failed++;
+      continue;
+    }
+    if (best_us < 1) best_us = 1;
+    printf("%-32s %8zu%c %5ux%-5u %9.2f %9.2f %8.1f %8.1f\n", name, size, streamed ? 's' : ' ',
+           width, height,
+           best_us / 1000.0, sum_us / 1000.0 / repeats, (double)width * height / best_us,
+           (double)size / best_us);
+    decoded++;
+    total_pixels += (uint64_t)width * height;
+    total_bytes += size;
+    total_best_us += best_us;
+  }
+
+  double mpix_per_s = total_best_us > 0 ? (double)total_pixels / total_best_us : 0;
+  printf("\n%d decoded, %d failed, %.2f ms per image, %.1f Mpix/s, %.1f MB/s\n", decoded, failed,
+         decoded ? total_best_us / 1000.0 / decoded : 0.0, mpix_per_s,
+         total_best_us > 0 ? (double)total_bytes / total_best_us : 0.0);
+  LogImageDecoderStats();
+  heap_caps_free(frame);
+  if (failed > 0) return 1;
+  if (gate_mpix_per_s > 0 && mpix_per_s < gate_mpix_per_s) {
+    printf("below the gate of %.1f Mpix/s\n", gate_mpix_per_s);
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,203 @@
+#include "host_stubs.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
+#include "axp2101_driver.h"
+#include "display_sh86001.h"
+#include "sdmmc_driver.h"
+
+void HostLog(char level, const char* tag, const char* format, ...) {
+  // HOST_LOG=I shows the info logs too, errors and warnings are always shown
+  static const char* max_level = getenv("HOST_LOG");
+  if (level != 'E' && level != 'W' && (max_level == NULL || level > max_level[0])) return;
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "%c (%s) ", level, tag);
+  vfprintf(stderr, format, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) { return malloc(size); }
+
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) { return realloc(ptr, size); }
+
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) { return calloc(n, size); }
+
+void heap_caps_free(void* ptr) { free(ptr); }
+
+int64_t esp_timer_get_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint32_t esp_random(void) { return (uint32_t)rand(); }
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* data, uint32_t length) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char* label) {
+  return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst,
+                             size_t size) {
+  return ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src,
+                              size_t size) {
+  return ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset,
+                                    size_t size) {
+  return ESP_FAIL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void** out_ptr,
+                             esp_partition_mmap_handle_t* out_handle) {
+  return ESP_FAIL;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {}
+
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  UBaseType_t count, max_count;
+} HostSemaphore;
+
+static SemaphoreHandle_t CreateSemaphore(UBaseType_t max_count, UBaseType_t count) {
+  HostSemaphore* semaphore = (HostSemaphore*)calloc(1, sizeof(HostSemaphore));
+  if (semaphore == NULL) return NULL;
+  pthread_mutex_init(&semaphore->mutex, NULL);
+  pthread_cond_init(&semaphore->cond, NULL);
+  semaphore->count = count;
+  semaphore->max_count = max_count;
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return CreateSemaphore(1, 1); }
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return CreateSemaphore(1, 0); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks) {
+  HostSemaphore* semaphore = (HostSemaphore*)handle;
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += ticks / 1000;
+  deadline.tv_nsec += (ticks % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  pthread_mutex_lock(&semaphore->mutex);
+  int ret = 0;
+  while (semaphore->count == 0 && ret == 0) {
+    if (ticks == portMAX_DELAY) {
+      ret = pthread_cond_wait(&semaphore->cond, &semaphore->mutex);
+    } else {
+      ret = pthread_cond_timedwait(&semaphore->cond, &semaphore->mutex, &deadline);
+    }
+  }
+  bool taken = semaphore->count > 0;
+  if (taken) semaphore->count--;
+  pthread_mutex_unlock(&semaphore->mutex);
+  return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+  HostSemaphore* semaphore = (HostSemaphore*)handle;
+  pthread_mutex_lock(&semaphore->mutex);
+  bool given = semaphore->count < semaphore->max_count;
+  if (given) {
+    semaphore->count++;
+    pthread_cond_signal(&semaphore->cond);
+  }
+  pthread_mutex_unlock(&semaphore->mutex);
+  return given ? pdTRUE : pdFALSE;
+}
+
+typedef struct {
+  TaskFunction_t function;
+  void* arg;
+} HostTask;
+
+static void* host_task_thread(void* arg) {
+  HostTask task = *(HostTask*)arg;
+  free(arg);
+  task.function(task.arg);
+  return NULL;
+}
+
+// priority and core are ignored, the stack size is left to pthreads
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_size,
+                                   void* arg, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+  HostTask* task = (HostTask*)malloc(sizeof(HostTask));
+  if (task == NULL) return pdFAIL;
+  task->function = function;
+  task->arg = arg;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, host_task_thread, task) != 0) {
+    free(task);
+    return pdFAIL;
+  }
+  pthread_detach(thread);
+  if (handle) *handle = (TaskHandle_t)thread;
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  struct timespec delay = {(time_t)(ticks / 1000), (long)(ticks % 1000) * 1000000L};
+  nanosleep(&delay, NULL);
+}
+
+static pthread_mutex_t critical_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+
+void HostEnterCritical(portMUX_TYPE* mux) { pthread_mutex_lock(&critical_mutex_); }
+
+void HostExitCritical(portMUX_TYPE* mux) { pthread_mutex_unlock(&critical_mutex_); }
+
+lv_obj_t* lv_scr_act(void) { return NULL; }
+
+void lv_obj_invalidate(const lv_obj_t* obj) {}
+
+// board drivers: no panel, no charger, parameters are kept in memory
+bool DisplayReserveDirectDraw() { return false; }
+
+bool DisplayBeginDirectDraw() { return false; }
+
+bool DisplayDrawStrip(int x, int y, int width, int height, const uint16_t* pixels) {
+  return false;
+}
+
+bool DisplayEndDirectDraw() { return true; }
+
+int32_t GetBatteryPercent() { return 100; }
+
+bool IsCharging() { return false; }
+
+static int32_t current_tab_ = 0;
+static int32_t image_decoder_ = -1;
+
+void ParameterSetCurrentTab(int32_t value) { current_tab_ = value; }
+
+int32_t ParameterGetCurrentTab() { return current_tab_; }
+
+void ParameterSetImageDecoder(int32_t value) { image_decoder_ = value; }
+
+int32_t ParameterGetImageDecoder(int32_t default_value) {
+  return image_decoder_ >= 0 ? image_decoder_ : default_value;
+}
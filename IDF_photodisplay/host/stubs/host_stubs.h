@@ -0,0 +1,108 @@
+#pragma once
+
+// the parts of ESP-IDF, FreeRTOS, LVGL and the board drivers the image pipeline uses, for the
+// host build. the IDF headers in this folder only include this one.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// esp_err / esp_log
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+void HostLog(char level, const char* tag, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+#define ESP_LOGE(tag, format, ...) HostLog('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HostLog('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HostLog('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HostLog('D', tag, format, ##__VA_ARGS__)
+
+// heap_caps, the capabilities are ignored
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+void* heap_caps_malloc(size_t size, uint32_t caps);
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps);
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+void heap_caps_free(void* ptr);
+
+int64_t esp_timer_get_time(void);
+uint32_t esp_random(void);
+// the ROM CRC-32, same result as zlib crc32(crc, data, length)
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* data, uint32_t length);
+
+// FreeRTOS, tasks are threads and semaphores are counting semaphores
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void* SemaphoreHandle_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffu
+#define pdMS_TO_TICKS(ms) (ms)
+#define portTICK_PERIOD_MS 1
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_size,
+                                   void* arg, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+// critical sections are one process wide lock
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+void HostEnterCritical(portMUX_TYPE* mux);
+void HostExitCritical(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(mux) HostEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) HostExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux) HostEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux) HostExitCritical(mux)
+
+// esp_partition, there is no flash: no partition is ever found
+typedef enum { ESP_PARTITION_TYPE_APP = 0, ESP_PARTITION_TYPE_DATA = 1 } esp_partition_type_t;
+typedef int esp_partition_subtype_t;
+typedef enum { ESP_PARTITION_MMAP_DATA = 0, ESP_PARTITION_MMAP_INST } esp_partition_mmap_memory_t;
+typedef uint32_t esp_partition_mmap_handle_t;
+typedef struct {
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+} esp_partition_t;
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst,
+                             size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src,
+                              size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size);
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void** out_ptr,
+                             esp_partition_mmap_handle_t* out_handle);
+void esp_partition_munmap(esp_partition_mmap_handle_t handle);
+
+// LVGL, the loader only invalidates the screen after a failed direct draw
+typedef struct _lv_obj_t lv_obj_t;
+lv_obj_t* lv_scr_act(void);
+void lv_obj_invalidate(const lv_obj_t* obj);
+
+#ifdef __cplusplus
+}
+#endif
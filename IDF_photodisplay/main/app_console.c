@@ -0,0 +1,457 @@
+#include "app_console.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clip_player.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "frame_cache.h"
+#include "frame_tiles.h"
+#include "image_decoder.h"
+#include "image_loader.h"
+#include "ken_burns.h"
+#include "latency_stats.h"
+#include "photo_pack.h"
+#include "photo_store.h"
+#include "sd_bench.h"
+#include "sdkconfig.h"
+#include "sdmmc_driver.h"
+#include "slide_transition.h"
+
+static const char* TAG = "CONSOLE";
+
+static void PrintMs(uint32_t us) {
+  printf(" %7lu.%lu", (unsigned long)(us / 1000), (unsigned long)(us % 1000 / 100));
+}
+
+static int latency_command(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+    ResetLatencyStats();
+    return 0;
+  }
+  if (argc > 1) {
+    printf("usage: latency [reset]\n");
+    return 1;
+  }
+  printf("stage       count    min ms    avg ms    p95 ms    max ms  (last %d)\n",
+         LATENCY_RING_SIZE);
+  for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+    LatencySummary summary;
+    GetLatencySummary((LatencyStage)i, &summary);
+    printf("%-8s %8lu", LatencyStageName((LatencyStage)i), (unsigned long)summary.count);
+    PrintMs(summary.min_us);
+    PrintMs(summary.avg_us);
+    PrintMs(summary.p95_us);
+    PrintMs(summary.max_us);
+    printf("\n");
+  }
+  return 0;
+}
+
+static int transition_command(int argc, char** argv) {
+  if (argc > 3) {
+    printf("usage: transition [none|crossfade|wipe|push] [ms]\n");
+    return 1;
+  }
+  if (argc > 1) {
+    SlideTransitionType type = SlideTransitionFromName(argv[1]);
+    uint32_t duration_ms = argc > 2 ? (uint32_t)atoi(argv[2]) : GetSlideTransitionMs();
+    if (type == SLIDE_TRANSITION_COUNT || !SetSlideTransition(type, duration_ms)) {
+      printf("unknown transition, longer than %d ms or no RAM for it\n", SLIDE_TRANSITION_MAX_MS);
+      return 1;
+    }
+  }
+  SlideTransitionStats stats;
+  GetSlideTransitionStats(&stats);
+  printf("%s, %lu ms\n", SlideTransitionName(GetSlideTransition()),
+         (unsigned long)GetSlideTransitionMs());
+  if (stats.played == 0) return 0;
+  printf("played %lu, %lu below %d fps\n", (unsigned long)stats.played, (unsigned long)stats.slow,
+         SLIDE_TRANSITION_TARGET_FPS);
+  unsigned long fps_x10 = stats.last_us ? stats.last_frames * 10000000ull / stats.last_us : 0;
+  printf("last: %lu frames in", (unsigned long)stats.last_frames);
+  PrintMs(stats.last_us);
+  printf(" ms, %lu.%lu fps, slowest frame", fps_x10 / 10, fps_x10 % 10);
+  PrintMs(stats.last_max_frame_us);
+  printf(" ms\n");
+  return 0;
+}
+
+static int kenburns_command(int argc, char** argv) {
+  if (argc > 2 || (argc == 2 && strcmp(argv[1], "on") != 0 && strcmp(argv[1], "off") != 0)) {
+    printf("usage: kenburns [on|off]\n");
+    return 1;
+  }
+  if (argc == 2) SetKenBurnsEnabled(strcmp(argv[1], "on") == 0);
+  KenBurnsStats stats;
+  GetKenBurnsStats(&stats);
+  LatencySummary frame;
+  GetLatencySummary(LATENCY_STAGE_FRAME, &frame);
+  printf("%s (from the next photo), target %d fps\n", KenBurnsEnabled() ? "on" : "off",
+         KEN_BURNS_FPS);
+#if !IMAGE_LOADER_KEN_BURNS
+  printf("photos are scaled to the screen, build with IMAGE_LOADER_KEN_BURNS to pan them\n");
+#endif
+  printf("pans %lu, frames %lu, late %lu\n", (unsigned long)stats.pans,
+         (unsigned long)stats.frames, (unsigned long)stats.late);
+  if (frame.samples == 0) return 0;
+  unsigned long fps_x10 = frame.avg_us ? 10000000ul / frame.avg_us : 0;
+  printf("frame interval, last %lu: avg", (unsigned long)frame.samples);
+  PrintMs(frame.avg_us);
+  printf(" ms (%lu.%lu fps), p95", fps_x10 / 10, fps_x10 % 10);
+  PrintMs(frame.p95_us);
+  printf(" ms, max");
+  PrintMs(frame.max_us);
+  printf(" ms\n");
+  return 0;
+}
+
+static int clip_command(int argc, char** argv) {
+  if (argc > 4 || (argc == 4 && strcmp(argv[3], "loop") != 0)) {
+    printf("usage: clip [stop | <file.avi|file.mjpg> [fps] [loop]]\n");
+    return 1;
+  }
+  if (argc > 1 && strcmp(argv[1], "stop") == 0) {
+    ClipPlayerStop();
+    return 0;
+  }
+  if (argc > 1) {
+    // names without a directory are in the photo folder
+    char path[128];
+    snprintf(path, sizeof(path), argv[1][0] == '/' ? "%s" : "/sd/prod/%s", argv[1]);
+    uint32_t fps = argc > 2 ? (uint32_t)atoi(argv[2]) : 0;
+    if (!ClipPlayerStart(path, fps, argc > 3)) {
+      printf("cannot play %s (playing already, no frames or above %d fps)\n", path,
+             CLIP_MAX_FPS);
+      return 1;
+    }
+    return 0;
+  }
+  ClipStats stats;
+  GetClipStats(&stats);
+  printf("%s, %lu clips\n", ClipPlayerActive() ? "playing" : "stopped",
+         (unsigned long)stats.clips);
+  if (stats.clips == 0) return 0;
+  unsigned long fps_x10 = stats.frame_us ? 10000000ul / stats.frame_us : 0;
+  printf("last: %lu frames at %lu.%lu fps\n", (unsigned long)stats.frames, fps_x10 / 10,
+         fps_x10 % 10);
+  printf("shown %lu, late %lu, skipped %lu, dropped %lu, failed %lu read %lu decode\n",
+         (unsigned long)stats.shown, (unsigned long)stats.late, (unsigned long)stats.skipped,
+         (unsigned long)stats.dropped, (unsigned long)stats.read_failed,
+         (unsigned long)stats.decode_failed);
+  return 0;
+}
+
+static int tiles_command(int argc, char** argv) {
+  FrameTileStats stats;
+  GetFrameTileStats(&stats);
+  printf("%dx%d tiles, %d per photo\n", FRAME_TILE_SIZE, FRAME_TILE_SIZE, FRAME_TILE_COUNT);
+  printf("updates %lu, unchanged %lu, merged %lu\n", (unsigned long)stats.updates,
+         (unsigned long)stats.unchanged, (unsigned long)stats.merged);
+  uint32_t total = stats.tiles_sent + stats.tiles_skipped;
+  if (total == 0) return 0;
+  printf("tiles sent %lu, skipped %lu (%lu%%)\n", (unsigned long)stats.tiles_sent,
+         (unsigned long)stats.tiles_skipped,
+         (unsigned long)((uint64_t)stats.tiles_skipped * 100 / total));
+  return 0;
+}
+
+static int decoder_command(int argc, char** argv) {
+  if (argc > 2) {
+    printf("usage: decoder [jpegdec|tjpgd]\n");
+    return 1;
+  }
+  if (argc == 2) {
+    ImageDecoderType type = ImageDecoderTypeFromName(argv[1]);
+    if (type == IMAGE_DECODER_QOI || !SetImageDecoder(type)) {
+      printf("no jpg decoder %s on this target\n", argv[1]);
+      return 1;
+    }
+  }
+  printf("jpg decoder %s\n", ActiveImageDecoder()->name);
+  printf("%-8s %8s %8s %8s %8s %8s %8s\n", "decoder", "decodes", "failed", "avg ms", "max ms",
+         "split", "split ms");
+  for (int i = 0; i < IMAGE_DECODER_COUNT; i++) {
+    const ImageDecoder* decoder = GetImageDecoder((ImageDecoderType)i);
+    if (decoder == NULL) continue;
+    ImageDecoderStats stats;
+    GetImageDecoderStats((ImageDecoderType)i, &stats);
+    printf("%-8s %8lu %8lu", decoder->name, (unsigned long)stats.decodes,
+           (unsigned long)stats.failures);
+    PrintMs(stats.decodes ? stats.total_us / stats.decodes : 0);
+    PrintMs(stats.max_us);
+    printf(" %8lu", (unsigned long)stats.split_decodes);
+    PrintMs(stats.split_decodes ? stats.split_total_us / stats.split_decodes : 0);
+    printf("\n");
+  }
+  return 0;
+}
+
+static int prefetch_command(int argc, char** argv) {
+  if (argc == 3 && strcmp(argv[1], "shuffle") == 0 &&
+      (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0)) {
+    SetImagePlaylistShuffle(strcmp(argv[2], "on") == 0);
+  } else if (argc > 1) {
+    printf("usage: prefetch [shuffle on|off]\n");
+    return 1;
+  }
+  ImagePrefetchStats stats;
+  GetImagePrefetchStats(&stats);
+  uint32_t changes = stats.hits + stats.misses;
+  printf("%d frames ahead, playlist %s\n", IMAGE_PREFETCH_DEPTH,
+         stats.shuffled ? "shuffled" : "in order");
+  printf("hits %lu, misses %lu (%lu%% hit rate)\n", (unsigned long)stats.hits,
+         (unsigned long)stats.misses,
+         (unsigned long)(changes ? (uint64_t)stats.hits * 100 / changes : 0));
+  printf("decoded %lu, invalidated %lu\n", (unsigned long)stats.decoded,
+         (unsigned long)stats.invalidations);
+  return 0;
+}
+
+static int cache_command(int argc, char** argv) {
+  if (argc == 2 && strcmp(argv[1], "clear") == 0) {
+    FrameCacheClear();
+  } else if (argc > 1) {
+    printf("usage: cache [clear]\n");
+    return 1;
+  }
+  FrameCacheStats stats;
+  GetFrameCacheStats(&stats);
+  uint32_t lookups = stats.hits + stats.misses;
+  printf("%lu entries, %lu of %d KB\n", (unsigned long)stats.entries,
+         (unsigned long)(stats.bytes_used / 1024), FRAME_CACHE_BUDGET_BYTES / 1024);
+  printf("hits %lu, misses %lu (%lu%% hit rate)\n", (unsigned long)stats.hits,
+         (unsigned long)stats.misses,
+         (unsigned long)(lookups ? (uint64_t)stats.hits * 100 / lookups : 0));
+  printf("evictions %lu, packed %lu\n", (unsigned long)stats.evictions,
+         (unsigned long)stats.compressions);
+  return 0;
+}
+
+static int pack_command(int argc, char** argv) {
+  PhotoPackStats stats;
+  GetPhotoPackStats(&stats);
+  if (stats.entries == 0) {
+    printf("no photo pack, photos are read from meta.txt\n");
+    return 0;
+  }
+  printf("%s: %lu photos\n", PHOTO_PACK_PATH, (unsigned long)stats.entries);
+  printf("reads %lu, streams %lu, %lu KB\n", (unsigned long)stats.reads,
+         (unsigned long)stats.streams, (unsigned long)(stats.bytes / 1024));
+  printf("failed %lu reads, %lu checksums\n", (unsigned long)stats.read_failed,
+         (unsigned long)stats.checksum_failed);
+  return 0;
+}
+
+static int store_command(int argc, char** argv) {
+  if (argc > 2 || (argc == 2 && strcmp(argv[1], "sync") != 0 && strcmp(argv[1], "force") != 0)) {
+    printf("usage: store [sync|force]\n");
+    return 1;
+  }
+  if (argc == 2) {
+    PhotoStoreSyncResult result = PhotoStoreSync(PHOTO_STORE_SOURCE, argv[1][0] == 'f');
+    if (result == PHOTO_STORE_SYNC_UP_TO_DATE) printf("the store already holds this pack\n");
+    if (result == PHOTO_STORE_SYNC_FAILED) printf("sync failed, the store is unchanged\n");
+    if (result == PHOTO_STORE_SYNC_DONE || result == PHOTO_STORE_SYNC_ERASED) {
+      // the playlist was built for the old store
+      printf("%s, restarting\n", result == PHOTO_STORE_SYNC_DONE ? "synced" : "sync failed");
+      esp_restart();
+    }
+    return result == PHOTO_STORE_SYNC_FAILED;
+  }
+  PhotoStoreStats stats;
+  GetPhotoStoreStats(&stats);
+  if (stats.size == 0) {
+    printf("no %s partition\n", PHOTO_STORE_LABEL);
+    return 0;
+  }
+  printf("%lu photos, %lu of %lu KB\n", (unsigned long)stats.entries,
+         (unsigned long)(stats.used / 1024), (unsigned long)(stats.size / 1024));
+  printf("maps %lu, failed %lu\n", (unsigned long)stats.maps, (unsigned long)stats.map_failed);
+  if (stats.sync_bytes > 0) {
+    printf("last sync %lu KB in %lu ms\n", (unsigned long)(stats.sync_bytes / 1024),
+           (unsigned long)stats.sync_ms);
+  }
+  return 0;
+}
+
+static int sdbus_command(int argc, char** argv) {
+  if (argc == 3) {
+    int width = atoi(argv[1]);
+    int freq_mhz = atoi(argv[2]);
+    if ((width != 1 && width != 4) || (freq_mhz != 20 && freq_mhz != 40)) {
+      printf("usage: sdbus [probe | <1|4> <20|40>]\n");
+      return 1;
+    }
+    ParameterSetSdmmcBusWidth(width);
+    ParameterSetSdmmcFreqKhz(freq_mhz * 1000);
+    printf("%d bit at %d MHz from the next boot\n", width, freq_mhz);
+    return 0;
+  }
+  if (argc == 2 && strcmp(argv[1], "probe") == 0) {
+    SdmmcProbeThroughput();
+  } else if (argc > 1) {
+    printf("usage: sdbus [probe | <1|4> <20|40>]\n");
+    return 1;
+  }
+  SdmmcBusInfo info;
+  GetSdmmcBusInfo(&info);
+  if (info.width == 0) {
+    printf("no SD card mounted\n");
+    return 0;
+  }
+  printf("%d bit bus at %d kHz (asked %d kHz), %d fallbacks\n", info.width, info.real_freq_khz,
+         info.freq_khz, info.fallbacks);
+  printf("sequential read %lu.%02lu MB/s\n", (unsigned long)(info.probe_kb_per_s / 1024),
+         (unsigned long)(info.probe_kb_per_s % 1024 * 100 / 1024));
+  return 0;
+}
+
+static int sdbench_command(int argc, char** argv) {
+  int files = argc > 1 ? atoi(argv[1]) : SD_BENCH_DEFAULT_FILES;
+  if (argc > 3 || files <= 0 || files > SD_BENCH_MAX_FILES) {
+    printf("usage: sdbench [files] [csv file]\n");
+    return 1;
+  }
+  FILE* out = stdout;
+  if (argc == 3) {
+    out = fopen(argv[2], "w");
+    if (out == NULL) {
+      printf("cannot create %s\n", argv[2]);
+      return 1;
+    }
+  }
+  bool ret = RunSdBenchmark(files, out);
+  if (out != stdout) {
+    fclose(out);
+    printf("%s %s\n", ret ? "report written to" : "benchmark failed, partial report in", argv[2]);
+  }
+  return ret ? 0 : 1;
+}
+
+void StartAppConsole() {
+  esp_console_repl_t* repl = NULL;
+  esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+  repl_config.prompt = "photo>";
+#if CONFIG_ESP_CONSOLE_UART_DEFAULT || CONFIG_ESP_CONSOLE_UART_CUSTOM
+  esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+  esp_err_t ret = esp_console_new_repl_uart(&hw_config, &repl_config, &repl);
+#elif CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+  esp_console_dev_usb_serial_jtag_config_t hw_config =
+      ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+  esp_err_t ret = esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &repl);
+#else
+  esp_err_t ret = ESP_ERR_NOT_SUPPORTED;
+#endif
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create the console: %s", esp_err_to_name(ret));
+    return;
+  }
+  esp_console_register_help_command();
+
+  const esp_console_cmd_t latency_cmd = {
+      .command = "latency",
+      .help = "per stage latency of the last slide changes (open, read, decode, wait, flush, "
+              "slide) and the Ken Burns frame interval, \"latency reset\" clears it",
+      .hint = "[reset]",
+      .func = latency_command,
+  };
+  esp_console_cmd_register(&latency_cmd);
+
+  const esp_console_cmd_t transition_cmd = {
+      .command = "transition",
+      .help = "slide transition and its duration, with the frame rate of the last one",
+      .hint = "[none|crossfade|wipe|push] [ms]",
+      .func = transition_command,
+  };
+  esp_console_cmd_register(&transition_cmd);
+
+  const esp_console_cmd_t kenburns_cmd = {
+      .command = "kenburns",
+      .help = "pan and zoom over photos larger than the screen, with its frame pacing",
+      .hint = "[on|off]",
+      .func = kenburns_command,
+  };
+  esp_console_cmd_register(&kenburns_cmd);
+
+  const esp_console_cmd_t tiles_cmd = {
+      .command = "tiles",
+      .help = "slide changes that only redrew the changed tiles, and the tiles they skipped",
+      .func = tiles_command,
+  };
+  esp_console_cmd_register(&tiles_cmd);
+
+  const esp_console_cmd_t decoder_cmd = {
+      .command = "decoder",
+      .help = "the jpg decoder in use with the decode times of every decoder, \"decoder tjpgd\" "
+              "switches from the next photo on and keeps it in NVS",
+      .hint = "[jpegdec|tjpgd]",
+      .func = decoder_command,
+  };
+  esp_console_cmd_register(&decoder_cmd);
+
+  const esp_console_cmd_t prefetch_cmd = {
+      .command = "prefetch",
+      .help = "slide changes served from the prefetched frames and the ones that waited, "
+              "\"prefetch shuffle on\" plays the photos in random order",
+      .hint = "[shuffle on|off]",
+      .func = prefetch_command,
+  };
+  esp_console_cmd_register(&prefetch_cmd);
+
+  const esp_console_cmd_t cache_cmd = {
+      .command = "cache",
+      .help = "the decoded frames cache with its hit rate, evictions and PSRAM in use, "
+              "\"cache clear\" drops all frames",
+      .hint = "[clear]",
+      .func = cache_command,
+  };
+  esp_console_cmd_register(&cache_cmd);
+
+  const esp_console_cmd_t pack_cmd = {
+      .command = "pack",
+      .help = "the photo pack in use, with the photos read from it and the failed reads",
+      .func = pack_command,
+  };
+  esp_console_cmd_register(&pack_cmd);
+
+  const esp_console_cmd_t store_cmd = {
+      .command = "store",
+      .help = "the photos in the flash store, \"store sync\" copies " PHOTO_STORE_SOURCE
+              " into it if it changed (force: always) and restarts",
+      .hint = "[sync|force]",
+      .func = store_command,
+  };
+  esp_console_cmd_register(&store_cmd);
+
+  const esp_console_cmd_t sdbus_cmd = {
+      .command = "sdbus",
+      .help = "SD bus width and clock in use with its sequential read speed, \"sdbus probe\" "
+              "measures it again, \"sdbus 4 40\" sets the bus tried first from the next boot",
+      .hint = "[probe | <1|4> <20|40>]",
+      .func = sdbus_command,
+  };
+  esp_console_cmd_register(&sdbus_cmd);
+
+  const esp_console_cmd_t sdbench_cmd = {
+      .command = "sdbench",
+      .help = "SD card benchmark under " SD_BENCH_DIR ": sequential reads per block size, random "
+              "4 KB reads, stat / fopen / first read over a directory of small files (default "
+              "200), as CSV on the console or into a file",
+      .hint = "[files] [csv file]",
+      .func = sdbench_command,
+  };
+  esp_console_cmd_register(&sdbench_cmd);
+
+  const esp_console_cmd_t clip_cmd = {
+      .command = "clip",
+      .help = "plays an MJPEG clip (AVI or concatenated jpgs) from the SD card, the frame rate "
+              "of the AVI unless given, with the frames shown and dropped",
+      .hint = "[stop | <file> [fps] [loop]]",
+      .func = clip_command,
+  };
+  esp_console_cmd_register(&clip_cmd);
+
+  ESP_ERROR_CHECK(esp_console_start_repl(repl));
+}
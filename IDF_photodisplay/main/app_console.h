@@ -0,0 +1,13 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// serial console (the ESP-IDF REPL on the primary console) with diagnostic commands, see
+// "help" once it runs
+void StartAppConsole();
+
+#ifdef __cplusplus
+}
+#endif
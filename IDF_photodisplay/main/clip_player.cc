@@ -0,0 +1,536 @@
+#include "clip_player.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "display_sh86001.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "image_decoder.h"
+#include "image_loader.h"
+#include "latency_stats.h"
+
+static const char* TAG = "CLIP";
+
+// alternating file buffers and frames
+#define CLIP_BUFFERS 2
+// how long the tasks block before they look at stop_ again
+#define CLIP_POLL_MS 20
+#define CLIP_FRAME_PIXELS (EXAMPLE_LCD_H_RES * EXAMPLE_LCD_V_RES)
+
+typedef struct {
+  int buffer;     // file buffer or frame
+  uint32_t seq;   // frame number since the start, loops included
+  uint32_t size;  // bytes of the compressed frame, 0 marks the end of the clip
+} ClipMessage;
+
+typedef struct {
+  uint16_t* pixels;
+  uint16_t width, height;
+} ClipFrame;
+
+static FILE* fp_ = NULL;
+static uint32_t* frame_offsets_ = NULL;
+static uint32_t* frame_sizes_ = NULL;
+static uint32_t frame_count_ = 0;
+static uint32_t frame_us_ = 0;
+static bool loop_ = false;
+static uint8_t* file_buffers_[CLIP_BUFFERS];
+static ClipFrame frames_[CLIP_BUFFERS];
+// buffer indices go around free_files_ -> reader -> full_files_ -> decoder -> free_files_, and
+// frames around free_frames_ -> decoder -> ready_frames_ -> LVGL -> free_frames_
+static QueueHandle_t free_files_ = NULL, full_files_ = NULL;
+static QueueHandle_t free_frames_ = NULL, ready_frames_ = NULL;
+static SemaphoreHandle_t tasks_done_ = NULL;
+static volatile bool active_ = false;
+static volatile bool stop_ = false;
+// frame seq is due at start_us_ + seq * frame_us_ once the first frame was shown. 32 bit, so the
+// tasks never see half of an update.
+static volatile uint32_t start_us_ = 0;
+static volatile bool started_ = false;
+// LVGL side: the frame being drawn, and the next one while it waits for its time
+static int shown_ = -1;
+static bool has_pending_ = false;
+static ClipMessage pending_;
+static uint32_t last_shown_us_ = 0;
+static ClipStats stats_;
+
+static uint32_t Le32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool ReadAt(uint32_t position, uint8_t* buffer, uint32_t size) {
+  return fseek(fp_, position, SEEK_SET) == 0 && fread(buffer, 1, size, fp_) == size;
+}
+
+static void AddFrame(uint32_t offset, uint32_t size) {
+  if (frame_count_ >= CLIP_MAX_FRAMES) return;
+  frame_offsets_[frame_count_] = offset;
+  frame_sizes_[frame_count_] = size;
+  frame_count_++;
+}
+
+// RIFF AVI: the frame interval from the avih header, the frames are the 00dc / 00db chunks of
+// the movi list (walked instead of trusting idx1, whose offsets differ between muxers)
+static void IndexAvi(uint32_t file_size, uint32_t* frame_us) {
+  uint8_t header[12];
+  if (!ReadAt(0, header, 12) || memcmp(header, "RIFF", 4) != 0 ||
+      memcmp(header + 8, "AVI ", 4) != 0) {
+    return;
+  }
+  uint32_t movi_start = 0, movi_end = 0;
+  uint32_t position = 12;
+  while (movi_start == 0 && position + 12 <= file_size && ReadAt(position, header, 12)) {
+    uint32_t size = Le32(header + 4);
+    if (memcmp(header, "LIST", 4) == 0 && memcmp(header + 8, "movi", 4) == 0) {
+      movi_start = position + 12;
+      movi_end = position + 8 + size;
+    } else if (memcmp(header, "LIST", 4) == 0 && memcmp(header + 8, "hdrl", 4) == 0) {
+      // avih is inside
+      position += 12;
+    } else {
+      // dwMicroSecPerFrame comes first in avih
+      if (memcmp(header, "avih", 4) == 0) *frame_us = Le32(header + 8);
+      position += 8 + size + (size & 1);
+    }
+  }
+  if (movi_end > file_size) movi_end = file_size;
+
+  position = movi_start;
+  while (movi_start != 0 && position + 8 <= movi_end && ReadAt(position, header, 8)) {
+    uint32_t size = Le32(header + 4);
+    if (memcmp(header, "LIST", 4) == 0) {
+      // rec lists group the chunks of one frame
+      position += 12;
+      continue;
+    }
+    if (header[2] == 'd' && (header[3] == 'c' || header[3] == 'b') && size > 0 &&
+        position + 8 + size <= movi_end) {
+      AddFrame(position + 8, size);
+    }
+    position += 8 + size + (size & 1);
+  }
+}
+
+// concatenated jpgs: the markers of every frame are walked from SOI to EOI, skipping the marker
+// segments, so jpgs embedded in them (EXIF thumbnails) are not taken for frames. in the entropy
+// coded data 0xff is only followed by 0x00 (stuffing) or a restart marker.
+typedef enum {
+  SCAN_SOI_FF = 0,
+  SCAN_SOI_D8,
+  SCAN_MARKER_FF,
+  SCAN_MARKER,
+  SCAN_LENGTH_HI,
+  SCAN_LENGTH_LO,
+  SCAN_SEGMENT,
+  SCAN_ENTROPY,
+  SCAN_ENTROPY_FF,
+} ScanState;
+
+typedef struct {
+  ScanState state;
+  uint32_t frame_start;
+  uint32_t remaining;  // bytes left in the marker segment
+  bool scan_follows;   // the segment is a start of scan header
+} JpgScanner;
+
+static void ScanMarker(JpgScanner* scanner, uint8_t marker, uint32_t position) {
+  if (marker == 0xff) return;  // fill byte
+  if (marker == 0xd9) {
+    AddFrame(scanner->frame_start, position + 1 - scanner->frame_start);
+    scanner->state = SCAN_SOI_FF;
+  } else if (marker == 0xd8) {
+    // a new frame before the end of the last one, the last one is cut short
+    scanner->frame_start = position - 1;
+    scanner->state = SCAN_MARKER_FF;
+  } else if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+    scanner->state = SCAN_MARKER_FF;
+  } else {
+    scanner->scan_follows = marker == 0xda;
+    scanner->state = SCAN_LENGTH_HI;
+  }
+}
+
+static void ScanJpgs(JpgScanner* scanner, const uint8_t* data, uint32_t size, uint32_t base) {
+  for (uint32_t i = 0; i < size; i++) {
+    uint8_t byte = data[i];
+    switch (scanner->state) {
+      case SCAN_SOI_FF:
+        if (byte == 0xff) scanner->state = SCAN_SOI_D8;
+        break;
+      case SCAN_SOI_D8:
+        if (byte == 0xd8) {
+          scanner->frame_start = base + i - 1;
+          scanner->state = SCAN_MARKER_FF;
+        } else if (byte != 0xff) {
+          scanner->state = SCAN_SOI_FF;
+        }
+        break;
+      case SCAN_MARKER_FF:
+        // anything else is broken, look for the next frame
+        scanner->state = byte == 0xff ? SCAN_MARKER : SCAN_SOI_FF;
+        break;
+      case SCAN_MARKER:
+        ScanMarker(scanner, byte, base + i);
+        break;
+      case SCAN_LENGTH_HI:
+        scanner->remaining = byte << 8;
+        scanner->state = SCAN_LENGTH_LO;
+        break;
+      case SCAN_LENGTH_LO:
+        scanner->remaining |= byte;
+        if (scanner->remaining < 2) {
+          scanner->state = SCAN_SOI_FF;
+          break;
+        }
+        scanner->remaining -= 2;
+        scanner->state = SCAN_SEGMENT;
+        if (scanner->remaining == 0) {
+          scanner->state = scanner->scan_follows ? SCAN_ENTROPY : SCAN_MARKER_FF;
+        }
+        break;
+      case SCAN_SEGMENT: {
+        uint32_t skip = size - i < scanner->remaining ? size - i : scanner->remaining;
+        scanner->remaining -= skip;
+        i += skip - 1;
+        if (scanner->remaining == 0) {
+          scanner->state = scanner->scan_follows ? SCAN_ENTROPY : SCAN_MARKER_FF;
+        }
+        break;
+      }
+      case SCAN_ENTROPY: {
+        const uint8_t* ff = (const uint8_t*)memchr(data + i, 0xff, size - i);
+        if (ff == NULL) {
+          i = size;
+        } else {
+          i = ff - data;
+          scanner->state = SCAN_ENTROPY_FF;
+        }
+        break;
+      }
+      case SCAN_ENTROPY_FF:
+        if (byte == 0x00 || (byte >= 0xd0 && byte <= 0xd7)) {
+          scanner->state = SCAN_ENTROPY;
+        } else if (byte != 0xff) {
+          // EOI, or the next table or scan of a progressive jpg
+          scanner->state = SCAN_MARKER;
+          ScanMarker(scanner, byte, base + i);
+        }
+        break;
+    }
+  }
+}
+
+static void IndexConcatenatedJpgs(uint32_t file_size) {
+  JpgScanner scanner = {};
+  uint8_t* chunk = file_buffers_[0];
+  fseek(fp_, 0, SEEK_SET);
+  for (uint32_t position = 0; position < file_size && frame_count_ < CLIP_MAX_FRAMES;) {
+    size_t length = fread(chunk, 1, CLIP_FILE_BUFFER_SIZE, fp_);
+    if (length == 0) break;
+    ScanJpgs(&scanner, chunk, length, position);
+    position += length;
+  }
+}
+
+static uint32_t NowUs() { return (uint32_t)esp_timer_get_time(); }
+
+// the frame that is due now, 0 until the clip started
+static uint32_t DueFrame() {
+  if (!started_) return 0;
+  return (NowUs() - start_us_) / frame_us_;
+}
+
+static void clip_reader_task(void* arg) {
+  uint32_t seq = 0;
+  while (!stop_) {
+    ClipMessage message;
+    if (xQueueReceive(free_files_, &message.buffer, pdMS_TO_TICKS(CLIP_POLL_MS)) != pdTRUE) {
+      continue;
+    }
+    // frames whose time already passed are not worth reading
+    uint32_t due = DueFrame();
+    if (seq < due) {
+      stats_.skipped += due - seq;
+      seq = due;
+    }
+    message.seq = seq;
+    if (!loop_ && seq >= frame_count_) {
+      message.size = 0;
+      xQueueSend(full_files_, &message, portMAX_DELAY);
+      break;
+    }
+    uint32_t index = seq++ % frame_count_;
+    message.size = frame_sizes_[index];
+    if (message.size > CLIP_FILE_BUFFER_SIZE ||
+        !ReadAt(frame_offsets_[index], file_buffers_[message.buffer], message.size)) {
+      stats_.read_failed++;
+      xQueueSend(free_files_, &message.buffer, 0);
+      continue;
+    }
+    xQueueSend(full_files_, &message, portMAX_DELAY);
+  }
+  xSemaphoreGive(tasks_done_);
+  vTaskDelete(NULL);
+}
+
+static bool clip_draw_callback(void* user, int x, int y, int w, int h, const uint16_t* pixels,
+                               int stride) {
+  ClipFrame* frame = (ClipFrame*)user;
+  uint16_t* dst = frame->pixels + y * frame->width + x;
+  // decoded straight into the frame
+  if (pixels == dst) return !stop_;
+  for (int j = 0; j < h; j++) memcpy(dst + j * frame->width, pixels + j * stride, w * 2);
+  return !stop_;
+}
+
+// clips should be made at the screen size, larger frames only get the decoder scale
+static bool DecodeClipFrame(const uint8_t* data, uint32_t size, ClipFrame* frame) {
+  const ImageDecoder* decoder = ActiveImageDecoder();
+  if (!decoder->open_memory(data, size)) return false;
+  ImageDecodeParams params = {};
+  uint32_t width = decoder->width(), height = decoder->height();
+  while (params.scale_shift < 3 && (width > EXAMPLE_LCD_H_RES || height > EXAMPLE_LCD_V_RES)) {
+    params.scale_shift++;
+    uint32_t round = (1 << params.scale_shift) - 1;
+    width = (decoder->width() + round) >> params.scale_shift;
+    height = (decoder->height() + round) >> params.scale_shift;
+  }
+  bool ret = width <= EXAMPLE_LCD_H_RES && height <= EXAMPLE_LCD_V_RES;
+  if (ret) {
+    frame->width = width;
+    frame->height = height;
+    params.format = IMAGE_PIXEL_RGB565_BE;
+    params.draw = clip_draw_callback;
+    params.user = frame;
+    params.framebuffer = frame->pixels;
+    ImageSplitResult split = ImageDecoderDecodeSplit(decoder, data, size, &params);
+    ret = split == IMAGE_SPLIT_UNSUPPORTED ? ImageDecoderDecode(decoder, &params)
+                                           : split == IMAGE_SPLIT_DECODED;
+  }
+  decoder->close();
+  return ret;
+}
+
+static void clip_decoder_task(void* arg) {
+  while (!stop_) {
+    ClipMessage message;
+    if (xQueueReceive(full_files_, &message, pdMS_TO_TICKS(CLIP_POLL_MS)) != pdTRUE) continue;
+    int file = message.buffer;
+    if (message.size == 0) {
+      // the end goes to the LVGL side like a frame, so the last one is shown for its time
+      message.buffer = -1;
+      xQueueSend(ready_frames_, &message, portMAX_DELAY);
+      break;
+    }
+    // more than a frame late by now, the next one is closer to its time
+    if (message.seq + 1 < DueFrame()) {
+      stats_.dropped++;
+      xQueueSend(free_files_, &file, 0);
+      continue;
+    }
+    int frame = -1;
+    while (!stop_ && xQueueReceive(free_frames_, &frame, pdMS_TO_TICKS(CLIP_POLL_MS)) != pdTRUE) {
+    }
+    if (stop_) break;
+    bool ret = DecodeClipFrame(file_buffers_[file], message.size, &frames_[frame]);
+    xQueueSend(free_files_, &file, 0);
+    if (!ret) {
+      if (!stop_) stats_.decode_failed++;
+      xQueueSend(free_frames_, &frame, 0);
+      continue;
+    }
+    message.buffer = frame;
+    xQueueSend(ready_frames_, &message, portMAX_DELAY);
+  }
+  xSemaphoreGive(tasks_done_);
+  vTaskDelete(NULL);
+}
+
+// everything ClipPlayerStart() set up, the tasks must be gone
+static void ReleaseClip() {
+  if (fp_) fclose(fp_);
+  fp_ = NULL;
+  for (int i = 0; i < CLIP_BUFFERS; i++) {
+    heap_caps_free(file_buffers_[i]);
+    file_buffers_[i] = NULL;
+    heap_caps_free(frames_[i].pixels);
+    frames_[i].pixels = NULL;
+  }
+  heap_caps_free(frame_offsets_);
+  heap_caps_free(frame_sizes_);
+  frame_offsets_ = frame_sizes_ = NULL;
+  QueueHandle_t* queues[] = {&free_files_, &full_files_, &free_frames_, &ready_frames_};
+  for (QueueHandle_t* queue : queues) {
+    if (*queue) vQueueDelete(*queue);
+    *queue = NULL;
+  }
+  if (tasks_done_) vSemaphoreDelete(tasks_done_);
+  tasks_done_ = NULL;
+  shown_ = -1;
+  has_pending_ = false;
+}
+
+static bool AllocateClip() {
+  for (int i = 0; i < CLIP_BUFFERS; i++) {
+    file_buffers_[i] = (uint8_t*)heap_caps_malloc(CLIP_FILE_BUFFER_SIZE,
+                                                  MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    frames_[i].pixels = (uint16_t*)heap_caps_malloc(CLIP_FRAME_PIXELS * 2,
+                                                    MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (file_buffers_[i] == NULL || frames_[i].pixels == NULL) return false;
+  }
+  frame_offsets_ = (uint32_t*)heap_caps_malloc(CLIP_MAX_FRAMES * sizeof(uint32_t),
+                                               MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  frame_sizes_ = (uint32_t*)heap_caps_malloc(CLIP_MAX_FRAMES * sizeof(uint32_t),
+                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  free_files_ = xQueueCreate(CLIP_BUFFERS, sizeof(int));
+  full_files_ = xQueueCreate(CLIP_BUFFERS, sizeof(ClipMessage));
+  free_frames_ = xQueueCreate(CLIP_BUFFERS, sizeof(int));
+  // one more slot for the end of the clip
+  ready_frames_ = xQueueCreate(CLIP_BUFFERS + 1, sizeof(ClipMessage));
+  tasks_done_ = xSemaphoreCreateCounting(2, 0);
+  return frame_offsets_ && frame_sizes_ && free_files_ && full_files_ && free_frames_ &&
+         ready_frames_ && tasks_done_;
+}
+
+bool ClipPlayerStart(const char* path, uint32_t fps, bool loop) {
+  if (active_ || fps > CLIP_MAX_FPS) return false;
+  int64_t start_us = esp_timer_get_time();
+  if (!AllocateClip()) {
+    ESP_LOGE(TAG, "Failed to allocate the clip buffers");
+    ReleaseClip();
+    return false;
+  }
+  fp_ = fopen(path, "rb");
+  if (fp_ == NULL) {
+    ESP_LOGE(TAG, "Failed to open %s", path);
+    ReleaseClip();
+    return false;
+  }
+  long size = fseek(fp_, 0, SEEK_END) == 0 ? ftell(fp_) : -1;
+  if (size <= 0) {
+    ESP_LOGE(TAG, "Failed to get the size of %s", path);
+    ReleaseClip();
+    return false;
+  }
+  uint32_t file_size = size;
+
+  frame_count_ = 0;
+  uint32_t header_frame_us = 0;
+  const char* dot = strrchr(path, '.');
+  if (dot && strcasecmp(dot, ".avi") == 0) {
+    IndexAvi(file_size, &header_frame_us);
+  } else {
+    IndexConcatenatedJpgs(file_size);
+  }
+  if (frame_count_ == 0) {
+    ESP_LOGE(TAG, "No frames in %s", path);
+    ReleaseClip();
+    return false;
+  }
+  if (fps > 0) {
+    frame_us_ = 1000000 / fps;
+  } else if (header_frame_us >= 1000000 / CLIP_MAX_FPS) {
+    frame_us_ = header_frame_us;
+  } else {
+    frame_us_ = 1000000 / CLIP_DEFAULT_FPS;
+  }
+  for (int i = 0; i < CLIP_BUFFERS; i++) {
+    xQueueSend(free_files_, &i, 0);
+    xQueueSend(free_frames_, &i, 0);
+  }
+  loop_ = loop;
+  stop_ = false;
+  started_ = false;
+  last_shown_us_ = 0;
+  stats_.clips++;
+  stats_.frames = frame_count_;
+  stats_.frame_us = frame_us_;
+  ESP_LOGI(TAG, "%s: %lu frames at %lu us, indexed in %d ms", path,
+           (unsigned long)frame_count_, (unsigned long)frame_us_,
+           (int)((esp_timer_get_time() - start_us) / 1000));
+
+  // the loader goes idle first, it shares the decoder
+  PauseImageLoader();
+  active_ = true;
+  xTaskCreatePinnedToCore(clip_reader_task, "ClipReader", CLIP_READER_TASK_STACK_SIZE, NULL,
+                          CLIP_READER_TASK_PRIORITY, NULL, CLIP_TASK_CORE);
+  xTaskCreatePinnedToCore(clip_decoder_task, "ClipDecoder", CLIP_DECODER_TASK_STACK_SIZE, NULL,
+                          CLIP_DECODER_TASK_PRIORITY, NULL, CLIP_TASK_CORE);
+  return true;
+}
+
+void ClipPlayerStop() { stop_ = true; }
+
+bool ClipPlayerActive() { return active_; }
+
+// waits for the tasks, which look at stop_ at least every CLIP_POLL_MS or after a decode
+static void EndClip() {
+  stop_ = true;
+  for (int i = 0; i < 2; i++) xSemaphoreTake(tasks_done_, portMAX_DELAY);
+  ReleaseClip();
+  active_ = false;
+  ResumeImageLoader();
+  ESP_LOGI(TAG, "clip ended, %lu shown, %lu skipped, %lu dropped, %lu late",
+           (unsigned long)stats_.shown, (unsigned long)stats_.skipped,
+           (unsigned long)stats_.dropped, (unsigned long)stats_.late);
+}
+
+ClipTickResult ClipPlayerTick() {
+  if (!active_) return CLIP_TICK_IDLE;
+  if (stop_) {
+    EndClip();
+    return CLIP_TICK_ENDED;
+  }
+  if (!has_pending_) has_pending_ = xQueueReceive(ready_frames_, &pending_, 0) == pdTRUE;
+  if (!has_pending_) return CLIP_TICK_IDLE;
+
+  uint32_t now_us = NowUs();
+  if (!started_) {
+    // the first frame starts the clock
+    start_us_ = now_us - pending_.seq * frame_us_;
+    started_ = true;
+  }
+  int32_t late_us = (int32_t)(now_us - (start_us_ + pending_.seq * frame_us_));
+  if (late_us < 0) return CLIP_TICK_IDLE;
+  has_pending_ = false;
+  if (pending_.size == 0) {
+    EndClip();
+    return CLIP_TICK_ENDED;
+  }
+
+  if (late_us > (int32_t)frame_us_ / 2) stats_.late++;
+  // LVGL is done with the last frame, the next refresh draws this one
+  if (shown_ >= 0) xQueueSend(free_frames_, &shown_, 0);
+  shown_ = pending_.buffer;
+  stats_.shown++;
+  if (last_shown_us_ != 0) LatencyRecord(LATENCY_STAGE_FRAME, now_us - last_shown_us_);
+  last_shown_us_ = now_us;
+  return CLIP_TICK_FRAME;
+}
+
+void ClipPlayerDraw(uint16_t* dst, int stride, int x1, int y1, int x2, int y2) {
+  const ClipFrame* frame = shown_ >= 0 ? &frames_[shown_] : NULL;
+  int width = frame ? frame->width : 0, height = frame ? frame->height : 0;
+  int left = (EXAMPLE_LCD_H_RES - width) / 2, top = (EXAMPLE_LCD_V_RES - height) / 2;
+  // the part of the row within the frame, black around it
+  int copy_x1 = x1 > left ? x1 : left;
+  int copy_x2 = x2 < left + width - 1 ? x2 : left + width - 1;
+  for (int y = y1; y <= y2; y++) {
+    uint16_t* out = dst + (y - y1) * stride;
+    if (y < top || y >= top + height || copy_x1 > copy_x2) {
+      memset(out, 0, (x2 - x1 + 1) * 2);
+      continue;
+    }
+    const uint16_t* row = frame->pixels + (y - top) * width;
+    memset(out, 0, (copy_x1 - x1) * 2);
+    memcpy(out + copy_x1 - x1, row + copy_x1 - left, (copy_x2 - copy_x1 + 1) * 2);
+    memset(out + copy_x2 - x1 + 1, 0, (x2 - copy_x2) * 2);
+  }
+}
+
+void GetClipStats(ClipStats* stats) { *stats = stats_; }
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// clip playback: short MJPEG clips (live photo style) streamed from the SD card, an AVI with
+// MJPEG video or plain concatenated jpgs (.mjpg). the frames are indexed when the clip starts.
+// a reader task streams them into two file buffers, a decoder task on the loader core decodes
+// them into two alternating frames and the LVGL task shows every frame at its time through the
+// clip view, so the SD reads, the decodes and the panel flushes overlap. frames that cannot make
+// their time anymore are dropped before they are read or decoded. the image loader is paused
+// while a clip plays, the two share the decoder.
+#define CLIP_DEFAULT_FPS 15
+#define CLIP_MAX_FPS 30
+#define CLIP_MAX_FRAMES 3000
+// compressed frames larger than this are skipped
+#define CLIP_FILE_BUFFER_SIZE (96 * 1024)
+// the LVGL timer that presents the frames
+#define CLIP_TICK_MS 5
+#define CLIP_READER_TASK_STACK_SIZE (4 * 1024)
+#define CLIP_READER_TASK_PRIORITY 4
+#define CLIP_DECODER_TASK_STACK_SIZE (8 * 1024)
+#define CLIP_DECODER_TASK_PRIORITY 3
+#define CLIP_TASK_CORE 1
+
+// every counter is only written by one task (noted below), so the counts are exact. a copy
+// taken while a clip plays may mix counters from slightly different moments.
+typedef struct {
+  uint32_t clips;          // clips started so far (ClipPlayerStart)
+  uint32_t frames;         // frames of the last clip (ClipPlayerStart)
+  uint32_t frame_us;       // frame interval of the last clip (ClipPlayerStart)
+  uint32_t shown;          // frames shown, loops included (LVGL)
+  uint32_t skipped;        // dropped before they were read (reader)
+  uint32_t dropped;        // dropped after they were read, before they were decoded (decoder)
+  uint32_t late;           // shown more than half a frame after their time (LVGL)
+  uint32_t read_failed;    // larger than CLIP_FILE_BUFFER_SIZE or a failed read (reader)
+  uint32_t decode_failed;  // not a jpg or larger than the screen even at 1/8 (decoder)
+} ClipStats;
+
+typedef enum {
+  CLIP_TICK_IDLE = 0,  // nothing to redraw
+  CLIP_TICK_FRAME,     // a new frame is due, redraw the clip view
+  CLIP_TICK_ENDED,     // the clip ended or was stopped, hide the clip view
+} ClipTickResult;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// from any task but the LVGL one. fps 0 takes the rate of the AVI header (CLIP_DEFAULT_FPS for
+// .mjpg). returns false if a clip is already playing or the file has no frames.
+bool ClipPlayerStart(const char* path, uint32_t fps, bool loop);
+// the clip stops with the next ClipPlayerTick()
+void ClipPlayerStop();
+bool ClipPlayerActive();
+// LVGL side, lock held: called every CLIP_TICK_MS from an LVGL timer
+ClipTickResult ClipPlayerTick();
+// draws the screen area x1..x2, y1..y2 (inclusive) of the shown frame into dst, which points to
+// the pixel at x1, y1 and has stride pixels per row. frames smaller than the screen are centered.
+void ClipPlayerDraw(uint16_t* dst, int stride, int x1, int y1, int x2, int y2);
+void GetClipStats(ClipStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
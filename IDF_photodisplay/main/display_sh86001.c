@@ -1,10 +1,25 @@
 
 #include "display_sh86001.h"
 #include "esp_lcd_panel_io.h"
+#include "latency_stats.h"
 
 static const char* TAG = "Display";
 static SemaphoreHandle_t lvgl_mux = NULL;
 
+// direct draw state, while active the color transfer done events belong to the direct writer
+static volatile bool direct_draw_active_ = false;
+// DisplayBeginDirectDraw(): the first DisplayDrawStrip() takes the LVGL lock, which is held
+// until DisplayEndDirectDraw()
+static bool direct_draw_per_image_ = false;
+static bool direct_draw_locked_ = false;
+// the strips drawn so far, and whether LVGL flushed over them
+static lv_area_t direct_draw_area_;
+static volatile bool direct_draw_overdrawn_ = false;
+static SemaphoreHandle_t direct_draw_done_ = NULL;
+static uint16_t* direct_strip_buf_[2] = {NULL, NULL};
+static int direct_strip_idx_ = 0;
+static int direct_inflight_ = 0;
+
 #if EXAMPLE_USE_TOUCH
 esp_lcd_touch_handle_t tp = NULL;
 #endif
@@ -23,6 +38,12 @@ static const sh8601_lcd_init_cmd_t lcd_init_cmds[] = {
 
 static bool example_notify_lvgl_flush_ready(esp_lcd_panel_io_handle_t panel_io,
                                             esp_lcd_panel_io_event_data_t* edata, void* user_ctx) {
+  if (direct_draw_active_) {
+    BaseType_t high_task_wakeup = pdFALSE;
+    xSemaphoreGiveFromISR(direct_draw_done_, &high_task_wakeup);
+    return high_task_wakeup == pdTRUE;
+  }
+  LatencyFlushDone();
   lv_disp_drv_t* disp_driver = (lv_disp_drv_t*)user_ctx;
   lv_disp_flush_ready(disp_driver);
   return false;
@@ -54,6 +75,11 @@ static void example_lvgl_flush_cb(lv_disp_drv_t* drv, const lv_area_t* area,
   }
 #endif
 
+  if (direct_draw_per_image_ && direct_draw_area_.x1 <= direct_draw_area_.x2 &&
+      _lv_area_is_on(area, &direct_draw_area_)) {
+    direct_draw_overdrawn_ = true;
+  }
+  LatencyFlushStarted(lv_disp_flush_is_last(drv));
   // copy a buffer's content to a specific area of the display
   esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1,
                             color_map);
@@ -167,6 +193,115 @@ static lv_disp_drv_t disp_drv;       // contains callback functions
 static esp_lcd_panel_handle_t panel_handle = NULL;
 static esp_lcd_panel_io_handle_t io_handle = NULL;
 
+static void StartDirectDraw() {
+  // the done event of a pending LVGL flush must still reach LVGL
+  while (disp_buf.flushing) {
+    vTaskDelay(pdMS_TO_TICKS(1));
+  }
+  direct_inflight_ = 0;
+  direct_draw_active_ = true;
+}
+
+bool DisplayReserveDirectDraw() {
+  for (int i = 0; i < 2; i++) {
+    if (direct_strip_buf_[i] != NULL) continue;
+    // internal RAM so the SPI DMA can read them directly
+    direct_strip_buf_[i] =
+        heap_caps_malloc(EXAMPLE_LCD_H_RES * DISPLAY_DIRECT_STRIP_LINES * sizeof(uint16_t),
+                         MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!direct_strip_buf_[i]) {
+      ESP_LOGE(TAG, "Failed to allocate direct draw strip buffer %d", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DisplayBeginDirectDraw() {
+  if (!direct_strip_buf_[0] || !direct_strip_buf_[1]) return false;
+  // the lock is taken with the first strip, LVGL keeps running while the header is parsed
+  lv_area_set(&direct_draw_area_, 1, 1, 0, 0);
+  direct_draw_overdrawn_ = false;
+  direct_draw_locked_ = false;
+  direct_draw_per_image_ = true;
+  return true;
+}
+
+bool DisplayBeginDirectDrawLocked() {
+  if (!direct_strip_buf_[0] || !direct_strip_buf_[1]) return false;
+  direct_draw_per_image_ = false;
+  StartDirectDraw();
+  return true;
+}
+
+static void DirectDrawWaitOne() {
+  xSemaphoreTake(direct_draw_done_, portMAX_DELAY);
+  direct_inflight_--;
+}
+
+uint16_t* DisplayNextStrip() {
+  if (!direct_draw_active_) return NULL;
+  // the buffer we are about to fill was sent two strips ago, wait for that transfer
+  if (direct_inflight_ >= 2) DirectDrawWaitOne();
+  return direct_strip_buf_[direct_strip_idx_];
+}
+
+bool DisplaySendStrip(int x, int y, int width, int lines) {
+  uint16_t* strip = direct_strip_buf_[direct_strip_idx_];
+  direct_strip_idx_ ^= 1;
+  if (esp_lcd_panel_draw_bitmap(panel_handle, x, y, x + width, y + lines, strip) != ESP_OK) {
+    return false;
+  }
+  direct_inflight_++;
+  return true;
+}
+
+static void StopDirectDraw() {
+  while (direct_inflight_ > 0) DirectDrawWaitOne();
+  direct_draw_active_ = false;
+}
+
+bool DisplayDrawStrip(int x, int y, int width, int height, const uint16_t* pixels) {
+  if (width > EXAMPLE_LCD_H_RES) return false;
+  if (direct_draw_per_image_ && !direct_draw_locked_) {
+    // LVGL must not flush while strips are on the bus, it waits until the image is done
+    if (!example_lvgl_lock(-1)) return false;
+    direct_draw_locked_ = true;
+    StartDirectDraw();
+  } else if (!direct_draw_active_) {
+    return false;
+  }
+  bool ret = true;
+  for (int row = 0; ret && row < height; row += DISPLAY_DIRECT_STRIP_LINES) {
+    int lines = height - row;
+    if (lines > DISPLAY_DIRECT_STRIP_LINES) lines = DISPLAY_DIRECT_STRIP_LINES;
+    // the decoder reuses its pixels once we return, the copy lets it go on with the next strip
+    // while this one is transferred. only a buffer sent two strips ago is waited for.
+    memcpy(DisplayNextStrip(), pixels + row * width, width * lines * 2);
+    ret = DisplaySendStrip(x, y + row, width, lines);
+  }
+  if (direct_draw_per_image_) {
+    lv_area_t strip = {x, y, x + width - 1, y + height - 1};
+    if (direct_draw_area_.x1 > direct_draw_area_.x2) {
+      direct_draw_area_ = strip;
+    } else {
+      _lv_area_join(&direct_draw_area_, &direct_draw_area_, &strip);
+    }
+  }
+  return ret;
+}
+
+bool DisplayEndDirectDraw() {
+  bool per_image = direct_draw_per_image_;
+  direct_draw_per_image_ = false;
+  if (direct_draw_active_) StopDirectDraw();
+  if (direct_draw_locked_) {
+    direct_draw_locked_ = false;
+    example_lvgl_unlock();
+  }
+  return !per_image || !direct_draw_overdrawn_;
+}
+
 void lcd_set_brightness(uint8_t brightness) {
   // uint8_t cmd = 0x51;   // DCS: Write Display Brightness
   // uint8_t data = brightness; // 0x00~0xFF
@@ -327,6 +462,10 @@ void InitializeLVGL() {
 
   lvgl_mux = xSemaphoreCreateMutex();
   assert(lvgl_mux);
-  xTaskCreate(example_lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE, NULL,
-              EXAMPLE_LVGL_TASK_PRIORITY, NULL);
+
+  // the strip buffers are allocated by DisplayReserveDirectDraw(), once a feature needs them
+  direct_draw_done_ = xSemaphoreCreateCounting(2, 0);
+  assert(direct_draw_done_);
+  xTaskCreatePinnedToCore(example_lvgl_port_task, "LVGL", EXAMPLE_LVGL_TASK_STACK_SIZE, NULL,
+                          EXAMPLE_LVGL_TASK_PRIORITY, NULL, EXAMPLE_LVGL_TASK_CORE);
 }
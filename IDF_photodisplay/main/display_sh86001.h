@@ -61,6 +61,14 @@
 #define EXAMPLE_LVGL_TASK_MIN_DELAY_MS 1
 #define EXAMPLE_LVGL_TASK_STACK_SIZE (4 * 1024)
 #define EXAMPLE_LVGL_TASK_PRIORITY 2
+#define EXAMPLE_LVGL_TASK_CORE 0
+
+// rows per internal-RAM strip buffer for direct panel writes (max MCU height is 16)
+#define DISPLAY_DIRECT_STRIP_LINES 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 void InitializeI2C();
 void InitializeDisplay();
@@ -69,3 +77,27 @@ void InitializeLVGL();
 bool example_lvgl_lock(int timeout_ms);
 void example_lvgl_unlock(void);
 void lcd_set_brightness(uint8_t brightness);
+
+// direct panel writes that bypass the LVGL draw buffers, used to push decoded strips straight
+// to the SH8601. strips go through two DMA-capable buffers in internal RAM, allocated by
+// DisplayReserveDirectDraw() (returns false if they cannot be), the Begin calls fail without
+// them. after DisplayBeginDirectDraw() the first DisplayDrawStrip() takes the LVGL lock, which is
+// held until DisplayEndDirectDraw(), so LVGL cannot flush between the strips of the image.
+bool DisplayReserveDirectDraw();
+bool DisplayBeginDirectDraw();
+// for callers that already hold the LVGL lock (LVGL timers and event callbacks), they keep it
+// until DisplayEndDirectDraw() and may use the zero copy strips below
+bool DisplayBeginDirectDrawLocked();
+bool DisplayDrawStrip(int x, int y, int width, int height, const uint16_t* pixels);
+// zero copy strips: DisplayNextStrip() waits until one of the strip buffers is free and returns
+// it (EXAMPLE_LCD_H_RES x DISPLAY_DIRECT_STRIP_LINES pixels), DisplaySendStrip() queues it for
+// the panel, so the next strip can be filled while this one is transferred.
+uint16_t* DisplayNextStrip();
+bool DisplaySendStrip(int x, int y, int width, int lines);
+// false if LVGL flushed over the strips drawn after DisplayBeginDirectDraw(), the panel may
+// then show parts of the old screen
+bool DisplayEndDirectDraw();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,247 @@
+#include "frame_cache.h"
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char* TAG = "FRAMECACHE";
+
+typedef struct {
+  int32_t image_id;  // -1 for an unused slot
+  uint16_t width;
+  uint16_t height;
+  uint16_t* data;
+  uint32_t size;  // bytes held by data
+  bool compressed;
+  bool incompressible;  // packing was tried and did not pay off
+  uint32_t last_used;
+} FrameCacheEntry;
+
+static FrameCacheEntry entries_[FRAME_CACHE_MAX_ENTRIES];
+static FrameCacheStats stats_;
+static uint32_t use_clock_ = 0;
+static SemaphoreHandle_t cache_mux_ = NULL;
+
+// packbits on 16 bit pixels: a control word with the top bit set is followed by one pixel that
+// repeats (control & 0x7fff) + 1 times, otherwise it is followed by control + 1 literal pixels.
+// returns the encoded size in words, 0 if it does not fit in dst_capacity.
+static uint32_t RleEncode(const uint16_t* src, uint32_t count, uint16_t* dst,
+                          uint32_t dst_capacity) {
+  uint32_t i = 0, o = 0;
+  while (i < count) {
+    uint32_t run = 1;
+    while (i + run < count && run < 0x8000 && src[i + run] == src[i]) run++;
+    // a run of two costs as much as two literals
+    if (run >= 3) {
+      if (o + 2 > dst_capacity) return 0;
+      dst[o++] = 0x8000 | (run - 1);
+      dst[o++] = src[i];
+      i += run;
+      continue;
+    }
+    uint32_t start = i, length = 0;
+    while (i < count && length < 0x8000) {
+      if (i + 2 < count && src[i] == src[i + 1] && src[i] == src[i + 2]) break;
+      i++;
+      length++;
+    }
+    if (o + 1 + length > dst_capacity) return 0;
+    dst[o++] = length - 1;
+    memcpy(dst + o, src + start, length * 2);
+    o += length;
+  }
+  return o;
+}
+
+static bool RleDecode(const uint16_t* src, uint32_t src_words, uint16_t* dst, uint32_t count) {
+  uint32_t i = 0, o = 0;
+  while (i < src_words && o < count) {
+    uint16_t control = src[i++];
+    uint32_t length = (control & 0x7fff) + 1;
+    if (o + length > count) return false;
+    if (control & 0x8000) {
+      if (i >= src_words) return false;
+      uint16_t pixel = src[i++];
+      for (uint32_t k = 0; k < length; k++) dst[o++] = pixel;
+    } else {
+      if (i + length > src_words) return false;
+      memcpy(dst + o, src + i, length * 2);
+      i += length;
+      o += length;
+    }
+  }
+  return o == count;
+}
+
+static void FreeEntry(FrameCacheEntry* entry) {
+  heap_caps_free(entry->data);
+  stats_.bytes_used -= entry->size;
+  stats_.entries--;
+  entry->data = NULL;
+  entry->size = 0;
+  entry->image_id = -1;
+}
+
+static FrameCacheEntry* FindEntry(int32_t image_id) {
+  for (int i = 0; i < FRAME_CACHE_MAX_ENTRIES; i++) {
+    if (entries_[i].image_id == image_id) return &entries_[i];
+  }
+  return NULL;
+}
+
+// least recently used entry, optionally only among the ones that can still be packed
+static FrameCacheEntry* ColdestEntry(bool packable_only) {
+  FrameCacheEntry* coldest = NULL;
+  for (int i = 0; i < FRAME_CACHE_MAX_ENTRIES; i++) {
+    FrameCacheEntry* entry = &entries_[i];
+    if (entry->image_id < 0) continue;
+    if (packable_only && (entry->compressed || entry->incompressible)) continue;
+    if (coldest == NULL || entry->last_used < coldest->last_used) coldest = entry;
+  }
+  return coldest;
+}
+
+static bool CompressEntry(FrameCacheEntry* entry) {
+  uint32_t count = (uint32_t)entry->width * entry->height;
+  // only worth it if it saves at least 1/8 of the frame
+  uint32_t capacity = count - count / 8;
+  uint16_t* packed =
+      (uint16_t*)heap_caps_malloc(capacity * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (packed == NULL) return false;
+
+  uint32_t words = RleEncode(entry->data, count, packed, capacity);
+  if (words == 0) {
+    heap_caps_free(packed);
+    entry->incompressible = true;
+    return false;
+  }
+  uint16_t* shrunk =
+      (uint16_t*)heap_caps_realloc(packed, words * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (shrunk != NULL) packed = shrunk;
+
+  heap_caps_free(entry->data);
+  stats_.bytes_used = stats_.bytes_used - entry->size + words * 2;
+  entry->data = packed;
+  entry->size = words * 2;
+  entry->compressed = true;
+  stats_.compressions++;
+  return true;
+}
+
+// pack or evict cold entries until size more bytes and one more slot fit in the budget
+static void MakeRoom(uint32_t size) {
+  while (stats_.entries > 0 && (stats_.bytes_used + size > FRAME_CACHE_BUDGET_BYTES ||
+                                stats_.entries >= FRAME_CACHE_MAX_ENTRIES)) {
+    if (FRAME_CACHE_COMPRESS && stats_.entries < FRAME_CACHE_MAX_ENTRIES) {
+      FrameCacheEntry* packable = ColdestEntry(true);
+      // no PSRAM for the packed copy: evict instead, trying the same entry again would spin
+      if (packable != NULL && (CompressEntry(packable) || packable->incompressible)) continue;
+    }
+    FreeEntry(ColdestEntry(false));
+    stats_.evictions++;
+  }
+}
+
+void InitializeFrameCache() {
+  for (int i = 0; i < FRAME_CACHE_MAX_ENTRIES; i++) {
+    entries_[i].image_id = -1;
+    entries_[i].data = NULL;
+  }
+  memset(&stats_, 0, sizeof(stats_));
+  cache_mux_ = xSemaphoreCreateMutex();
+}
+
+bool FrameCacheLookup(int32_t image_id, uint16_t* pixels, uint32_t max_pixels, uint16_t* width,
+                      uint16_t* height) {
+  if (cache_mux_ == NULL) return false;
+  xSemaphoreTake(cache_mux_, portMAX_DELAY);
+  FrameCacheEntry* entry = FindEntry(image_id);
+  bool ret = entry != NULL && (uint32_t)entry->width * entry->height <= max_pixels;
+  if (ret) {
+    uint32_t count = (uint32_t)entry->width * entry->height;
+    if (entry->compressed) {
+      ret = RleDecode(entry->data, entry->size / 2, pixels, count);
+    } else {
+      memcpy(pixels, entry->data, count * 2);
+    }
+  }
+  if (ret) {
+    *width = entry->width;
+    *height = entry->height;
+    entry->last_used = ++use_clock_;
+    stats_.hits++;
+  } else {
+    stats_.misses++;
+  }
+  xSemaphoreGive(cache_mux_);
+  return ret;
+}
+
+void FrameCacheInsert(int32_t image_id, const uint16_t* pixels, uint16_t width, uint16_t height) {
+  uint32_t size = (uint32_t)width * height * 2;
+  if (cache_mux_ == NULL || size == 0 || size > FRAME_CACHE_BUDGET_BYTES) return;
+  xSemaphoreTake(cache_mux_, portMAX_DELAY);
+  FrameCacheEntry* entry = FindEntry(image_id);
+  if (entry != NULL) {
+    entry->last_used = ++use_clock_;
+    xSemaphoreGive(cache_mux_);
+    return;
+  }
+
+  MakeRoom(size);
+  uint16_t* data = (uint16_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  // a fragmented heap can refuse the block even within the budget, evict until it fits
+  while (data == NULL && stats_.entries > 0) {
+    FreeEntry(ColdestEntry(false));
+    stats_.evictions++;
+    data = (uint16_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  }
+  if (data != NULL) {
+    entry = FindEntry(-1);
+    memcpy(data, pixels, size);
+    entry->image_id = image_id;
+    entry->width = width;
+    entry->height = height;
+    entry->data = data;
+    entry->size = size;
+    entry->compressed = false;
+    entry->incompressible = false;
+    entry->last_used = ++use_clock_;
+    stats_.bytes_used += size;
+    stats_.entries++;
+  } else {
+    ESP_LOGE(TAG, "Failed to allocate %lu bytes for image %d", (unsigned long)size, (int)image_id);
+  }
+  xSemaphoreGive(cache_mux_);
+}
+
+void FrameCacheClear() {
+  if (cache_mux_ == NULL) return;
+  xSemaphoreTake(cache_mux_, portMAX_DELAY);
+  for (int i = 0; i < FRAME_CACHE_MAX_ENTRIES; i++) {
+    if (entries_[i].image_id >= 0) FreeEntry(&entries_[i]);
+  }
+  xSemaphoreGive(cache_mux_);
+}
+
+void GetFrameCacheStats(FrameCacheStats* stats) {
+  if (cache_mux_ == NULL) {
+    memset(stats, 0, sizeof(FrameCacheStats));
+    return;
+  }
+  xSemaphoreTake(cache_mux_, portMAX_DELAY);
+  *stats = stats_;
+  xSemaphoreGive(cache_mux_);
+}
+
+void LogFrameCacheStats() {
+  FrameCacheStats stats;
+  GetFrameCacheStats(&stats);
+  uint32_t lookups = stats.hits + stats.misses;
+  ESP_LOGI(TAG, "hit rate %lu%% (%lu/%lu), %lu entries, %lu KB used, %lu evictions, %lu packed",
+           (unsigned long)(lookups ? stats.hits * 100 / lookups : 0), (unsigned long)stats.hits,
+           (unsigned long)lookups, (unsigned long)stats.entries,
+           (unsigned long)(stats.bytes_used / 1024), (unsigned long)stats.evictions,
+           (unsigned long)stats.compressions);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// LRU cache of decoded RGB565 frames in PSRAM, keyed by image id, so going back and forth
+// between a few photos does not hit the SD card or the decoder again.
+// entries are stored raw, when the byte budget is exceeded the coldest ones are first packed
+// with a lossless 16 bit run length code and only evicted if that is not enough.
+#define FRAME_CACHE_BUDGET_BYTES (2 * 1024 * 1024)
+#define FRAME_CACHE_MAX_ENTRIES 32
+#define FRAME_CACHE_COMPRESS 1
+
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+  uint32_t compressions;  // cold entries packed to stay within the budget
+  uint32_t bytes_used;
+  uint32_t entries;
+} FrameCacheStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void InitializeFrameCache();
+// copies the cached frame into pixels, max_pixels is the capacity of pixels
+bool FrameCacheLookup(int32_t image_id, uint16_t* pixels, uint32_t max_pixels, uint16_t* width,
+                      uint16_t* height);
+void FrameCacheInsert(int32_t image_id, const uint16_t* pixels, uint16_t width, uint16_t height);
+void FrameCacheClear();
+void GetFrameCacheStats(FrameCacheStats* stats);
+void LogFrameCacheStats();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,80 @@
+#include "frame_tiles.h"
+
+// tiles are hashed two pixels at a time
+static_assert(EXAMPLE_LCD_H_RES % 2 == 0, "the screen width has to be even");
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+static FrameTileStats stats_;
+
+void FrameTilesHash(const uint16_t* pixels, uint32_t* hashes) {
+  for (int i = 0; i < FRAME_TILE_COUNT; i++) hashes[i] = FNV_OFFSET;
+  // row by row through the frame, so PSRAM is read sequentially
+  for (int y = 0; y < EXAMPLE_LCD_V_RES; y++) {
+    const uint32_t* row = (const uint32_t*)(pixels + y * EXAMPLE_LCD_H_RES);
+    uint32_t* tile_hash = hashes + (y / FRAME_TILE_SIZE) * FRAME_TILE_COLUMNS;
+    for (int x = 0; x < EXAMPLE_LCD_H_RES / 2; x++) {
+      uint32_t* hash = &tile_hash[x / (FRAME_TILE_SIZE / 2)];
+      *hash = (*hash ^ row[x]) * FNV_PRIME;
+    }
+  }
+}
+
+int FrameTilesDiff(const uint32_t* shown, const uint32_t* next, FrameTileArea* areas) {
+  int count = 0;
+  FrameTileArea bounds = {EXAMPLE_LCD_H_RES, EXAMPLE_LCD_V_RES, 0, 0};
+  for (int row = 0; row < FRAME_TILE_ROWS; row++) {
+    int first = -1, last = -1;
+    for (int column = 0; column < FRAME_TILE_COLUMNS; column++) {
+      int i = row * FRAME_TILE_COLUMNS + column;
+      if (shown[i] == next[i]) continue;
+      if (first < 0) first = column;
+      last = column;
+    }
+    if (first < 0) continue;
+
+    // the changed span of the tile row, clipped to the screen
+    FrameTileArea area;
+    area.x1 = first * FRAME_TILE_SIZE;
+    area.y1 = row * FRAME_TILE_SIZE;
+    area.x2 = (last + 1) * FRAME_TILE_SIZE - 1;
+    area.y2 = (row + 1) * FRAME_TILE_SIZE - 1;
+    if (area.x2 >= EXAMPLE_LCD_H_RES) area.x2 = EXAMPLE_LCD_H_RES - 1;
+    if (area.y2 >= EXAMPLE_LCD_V_RES) area.y2 = EXAMPLE_LCD_V_RES - 1;
+    if (area.x1 < bounds.x1) bounds.x1 = area.x1;
+    if (area.y1 < bounds.y1) bounds.y1 = area.y1;
+    if (area.x2 > bounds.x2) bounds.x2 = area.x2;
+    bounds.y2 = area.y2;
+
+    // consecutive rows with the same span make one area
+    if (count > 0 && count <= FRAME_TILE_MAX_AREAS) {
+      FrameTileArea* previous = &areas[count - 1];
+      if (previous->x1 == area.x1 && previous->x2 == area.x2 && previous->y2 + 1 == area.y1) {
+        previous->y2 = area.y2;
+        continue;
+      }
+    }
+    if (count < FRAME_TILE_MAX_AREAS) areas[count] = area;
+    count++;
+  }
+  if (count > FRAME_TILE_MAX_AREAS) {
+    areas[0] = bounds;
+    count = 1;
+    stats_.merged++;
+  }
+
+  uint32_t sent = 0;
+  for (int i = 0; i < count; i++) {
+    uint32_t columns = (areas[i].x2 - areas[i].x1) / FRAME_TILE_SIZE + 1;
+    uint32_t rows = (areas[i].y2 - areas[i].y1) / FRAME_TILE_SIZE + 1;
+    sent += columns * rows;
+  }
+  stats_.updates++;
+  if (count == 0) stats_.unchanged++;
+  stats_.tiles_sent += sent;
+  stats_.tiles_skipped += FRAME_TILE_COUNT - sent;
+  return count;
+}
+
+void GetFrameTileStats(FrameTileStats* stats) { *stats = stats_; }
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "display_sh86001.h"
+
+// dirty tiles: the loader hashes every full screen frame in FRAME_TILE_SIZE square tiles, and a
+// slide change only redraws the tiles whose hash differs from the photo on the panel, so the
+// letterbox bars of fitted photos and the unchanged parts of similar shots are not sent again.
+#define FRAME_TILE_SIZE 16
+#define FRAME_TILE_COLUMNS ((EXAMPLE_LCD_H_RES + FRAME_TILE_SIZE - 1) / FRAME_TILE_SIZE)
+#define FRAME_TILE_ROWS ((EXAMPLE_LCD_V_RES + FRAME_TILE_SIZE - 1) / FRAME_TILE_SIZE)
+#define FRAME_TILE_COUNT (FRAME_TILE_COLUMNS * FRAME_TILE_ROWS)
+// LVGL keeps up to 32 invalidated areas per refresh and redraws the whole screen beyond that,
+// more dirty areas than this are merged into their bounding box
+#define FRAME_TILE_MAX_AREAS 16
+
+// screen area in pixels, inclusive like lv_area_t
+typedef struct {
+  int16_t x1, y1, x2, y2;
+} FrameTileArea;
+
+typedef struct {
+  uint32_t updates;        // slide changes that redrew only the changed tiles
+  uint32_t unchanged;      // of those, the ones where no tile changed at all
+  uint32_t tiles_sent;     // tiles redrawn by the updates, merged areas included
+  uint32_t tiles_skipped;  // tiles the updates left as they were on the panel
+  uint32_t merged;         // updates with too many areas, sent as their bounding box
+} FrameTileStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// hashes of the FRAME_TILE_COUNT tiles of a full screen frame, row by row
+void FrameTilesHash(const uint16_t* pixels, uint32_t* hashes);
+// the areas to redraw to go from the shown tiles to the next ones, returns how many were written
+// to areas (FRAME_TILE_MAX_AREAS at most), 0 when the two frames look the same
+int FrameTilesDiff(const uint32_t* shown, const uint32_t* next, FrameTileArea* areas);
+void GetFrameTileStats(FrameTileStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,155 @@
+#include "image_decoder.h"
+#include <string.h>
+#include <strings.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdmmc_driver.h"
+
+static const char* TAG = "DECODER";
+
+static const ImageDecoder* decoders_[IMAGE_DECODER_COUNT] = {
+    &kJpegdecDecoder,
+#if CONFIG_ESP_ROM_HAS_JPEG_DECODE
+    &kTjpgdDecoder,
+#else
+    NULL,
+#endif
+    &kQoiDecoder,
+};
+static ImageDecoderStats stats_[IMAGE_DECODER_COUNT];
+// read once per image by the loader task, so switching never affects a running decode
+static volatile ImageDecoderType active_type_ = IMAGE_DECODER_DEFAULT;
+
+void InitializeImageDecoder() {
+  int32_t type = ParameterGetImageDecoder(IMAGE_DECODER_DEFAULT);
+  if (type == IMAGE_DECODER_QOI || GetImageDecoder((ImageDecoderType)type) == NULL) {
+    type = IMAGE_DECODER_DEFAULT;
+  }
+  active_type_ = (ImageDecoderType)type;
+  ESP_LOGI(TAG, "using %s", decoders_[active_type_]->name);
+}
+
+const ImageDecoder* GetImageDecoder(ImageDecoderType type) {
+  if (type < 0 || type >= IMAGE_DECODER_COUNT) return NULL;
+  return decoders_[type];
+}
+
+const ImageDecoder* ActiveImageDecoder() { return decoders_[active_type_]; }
+
+ImageDecoderType ActiveImageDecoderType() { return active_type_; }
+
+bool SetImageDecoder(ImageDecoderType type) {
+  if (type == IMAGE_DECODER_QOI || GetImageDecoder(type) == NULL) return false;
+  if (type != active_type_) {
+    active_type_ = type;
+    ParameterSetImageDecoder(type);
+    ESP_LOGI(TAG, "switched to %s", decoders_[type]->name);
+  }
+  return true;
+}
+
+ImageDecoderType ImageDecoderTypeFromName(const char* name) {
+  // the decoders that are not built in have no ImageDecoder to take the name from
+  static const char* kNames[IMAGE_DECODER_COUNT] = {"jpegdec", "tjpgd", "qoi"};
+  for (int i = 0; i < IMAGE_DECODER_COUNT; i++) {
+    if (strcasecmp(name, kNames[i]) == 0) return (ImageDecoderType)i;
+  }
+  return IMAGE_DECODER_COUNT;
+}
+
+const ImageDecoder* ImageDecoderForPath(const char* path) {
+  size_t length = strlen(path);
+  if (length > 4 && strcasecmp(path + length - 4, ".qoi") == 0) return &kQoiDecoder;
+  return ActiveImageDecoder();
+}
+
+static void InitializeDecodeClip(const ImageDecoder* decoder, const ImageDecodeParams* params,
+                                 ImageDecodeClip* clip) {
+  uint16_t width = decoder->width(), height = decoder->height();
+  int shift = params->scale_shift;
+  int round = (1 << shift) - 1;
+  int x1 = params->w > 0 ? params->x + params->w : width;
+  int y1 = params->h > 0 ? params->y + params->h : height;
+  clip->params = params;
+  clip->x0 = params->x >> shift;
+  clip->y0 = params->y >> shift;
+  clip->x1 = ((x1 < width ? x1 : width) + round) >> shift;
+  clip->y1 = ((y1 < height ? y1 : height) + round) >> shift;
+  clip->done = false;
+}
+
+static void RecordDecode(const ImageDecoder* decoder, bool ret, uint32_t elapsed_us, bool split) {
+  for (int i = 0; i < IMAGE_DECODER_COUNT; i++) {
+    if (decoders_[i] != decoder) continue;
+    if (ret) {
+      stats_[i].decodes++;
+      stats_[i].total_us += elapsed_us;
+      if (elapsed_us > stats_[i].max_us) stats_[i].max_us = elapsed_us;
+      if (split) {
+        stats_[i].split_decodes++;
+        stats_[i].split_total_us += elapsed_us;
+      }
+    } else {
+      stats_[i].failures++;
+    }
+  }
+}
+
+bool ImageDecoderDecode(const ImageDecoder* decoder, const ImageDecodeParams* params) {
+  ImageDecodeClip clip;
+  InitializeDecodeClip(decoder, params, &clip);
+  int64_t start_us = esp_timer_get_time();
+  bool ret = decoder->decode(&clip) || clip.done;
+  RecordDecode(decoder, ret, esp_timer_get_time() - start_us, false);
+  return ret;
+}
+
+ImageSplitResult ImageDecoderDecodeSplit(const ImageDecoder* decoder, const uint8_t* data,
+                                         uint32_t size, const ImageDecodeParams* params) {
+  if (decoder != &kJpegdecDecoder) return IMAGE_SPLIT_UNSUPPORTED;
+  ImageDecodeClip clip;
+  InitializeDecodeClip(decoder, params, &clip);
+  int64_t start_us = esp_timer_get_time();
+  ImageSplitResult result = JpegdecDecodeSplit(data, size, &clip);
+  if (result != IMAGE_SPLIT_UNSUPPORTED) {
+    RecordDecode(decoder, result == IMAGE_SPLIT_DECODED, esp_timer_get_time() - start_us, true);
+  }
+  return result;
+}
+
+bool ImageDecodeClipBlock(ImageDecodeClip* clip, int x, int y, int w, int h,
+                          const uint16_t* pixels, int stride) {
+  // blocks come in rows from the top, nothing after this one is in the region
+  if (y >= clip->y1) {
+    clip->done = true;
+    return false;
+  }
+  int left = x > clip->x0 ? x : clip->x0;
+  int right = x + w < clip->x1 ? x + w : clip->x1;
+  int top = y > clip->y0 ? y : clip->y0;
+  int bottom = y + h < clip->y1 ? y + h : clip->y1;
+  if (left >= right || top >= bottom) return true;
+  pixels += (top - y) * stride + (left - x);
+  return clip->params->draw(clip->params->user, left - clip->x0, top - clip->y0, right - left,
+                            bottom - top, pixels, stride);
+}
+
+void GetImageDecoderStats(ImageDecoderType type, ImageDecoderStats* stats) {
+  *stats = stats_[type];
+}
+
+void LogImageDecoderStats() {
+  for (int i = 0; i < IMAGE_DECODER_COUNT; i++) {
+    if (decoders_[i] == NULL || stats_[i].decodes + stats_[i].failures == 0) continue;
+    const ImageDecoderStats* stats = &stats_[i];
+    ESP_LOGI(TAG, "%s: %lu decodes, avg %lu ms, max %lu ms, %lu failures", decoders_[i]->name,
+             (unsigned long)stats->decodes,
+             (unsigned long)(stats->decodes ? stats->total_us / stats->decodes / 1000 : 0),
+             (unsigned long)(stats->max_us / 1000), (unsigned long)stats->failures);
+    if (stats->split_decodes > 0) {
+      ESP_LOGI(TAG, "%s: %lu split decodes, avg %lu ms", decoders_[i]->name,
+               (unsigned long)stats->split_decodes,
+               (unsigned long)(stats->split_total_us / stats->split_decodes / 1000));
+    }
+  }
+}
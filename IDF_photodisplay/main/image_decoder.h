@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+// image decoders behind one interface, the loader uses the one picked with SetImageDecoder().
+// JPEGDEC: bitbank2 JPEGDEC with the ESP32-S3 SIMD paths, ~17.5 KB of internal RAM once used.
+// TJPGD: the TJpgDec in the ESP32-S3 ROM, ~3 KB of work area and no code in flash.
+// QOI: not a jpg decoder, used for .qoi files whatever jpg decoder is picked.
+typedef enum {
+  IMAGE_DECODER_JPEGDEC = 0,
+  IMAGE_DECODER_TJPGD,
+  IMAGE_DECODER_QOI,
+  IMAGE_DECODER_COUNT,
+} ImageDecoderType;
+
+// used until a decoder is stored in NVS
+#define IMAGE_DECODER_DEFAULT IMAGE_DECODER_JPEGDEC
+
+typedef enum {
+  IMAGE_PIXEL_RGB565_BE = 0,  // what the SH8601 panel and the LVGL image take
+  IMAGE_PIXEL_RGB565_LE,
+} ImagePixelFormat;
+
+// stream source, read returns the number of bytes read
+typedef int32_t (*ImageReadCallback)(void* handle, uint8_t* buffer, int32_t length);
+typedef bool (*ImageSeekCallback)(void* handle, int32_t position);
+// gets a w x h block of output pixels at (x, y), rows are stride pixels apart.
+// returning false stops the decode.
+typedef bool (*ImageDrawCallback)(void* user, int x, int y, int w, int h, const uint16_t* pixels,
+                                  int stride);
+
+typedef struct {
+  // region of the source image, w or h 0 means up to the right or bottom edge
+  int x, y, w, h;
+  // the output is downscaled by 1 << scale_shift (0 ~ 3), its origin is the region origin
+  uint8_t scale_shift;
+  ImagePixelFormat format;
+  ImageDrawCallback draw;
+  void* user;
+  // optional, the frame the draw callback copies a whole image decode into (rows are the scaled
+  // width apart). backends that can write there directly do so and pass the draw callback
+  // pointers into it, so it has nothing to copy.
+  uint16_t* framebuffer;
+} ImageDecodeParams;
+
+// region of a decode in scaled image pixels, the backends pass every decoded block through
+// ImageDecodeClipBlock() instead of calling the draw callback themselves.
+typedef struct {
+  const ImageDecodeParams* params;
+  int x0, y0, x1, y1;
+  bool done;  // the decode went past the bottom of the region, stopping early is a success
+} ImageDecodeClip;
+
+typedef struct {
+  const char* name;
+  // the stream starts at the beginning of the image (seek positions are relative to that),
+  // the caller keeps ownership of it
+  bool (*open_memory)(const uint8_t* data, uint32_t size);
+  bool (*open_stream)(void* handle, uint32_t size, ImageReadCallback read, ImageSeekCallback seek);
+  uint16_t (*width)();
+  uint16_t (*height)();
+  // one decode per open
+  bool (*decode)(ImageDecodeClip* clip);
+  void (*close)();
+} ImageDecoder;
+
+typedef struct {
+  uint32_t decodes;
+  uint32_t failures;
+  uint64_t total_us;
+  uint32_t max_us;
+  uint32_t split_decodes;  // the part of decodes that ran on both cores
+  uint64_t split_total_us;
+} ImageDecoderStats;
+
+typedef enum {
+  IMAGE_SPLIT_DECODED = 0,
+  IMAGE_SPLIT_FAILED,
+  IMAGE_SPLIT_UNSUPPORTED,  // decode it the normal way
+} ImageSplitResult;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const ImageDecoder kJpegdecDecoder;
+#if CONFIG_ESP_ROM_HAS_JPEG_DECODE
+extern const ImageDecoder kTjpgdDecoder;
+#endif
+extern const ImageDecoder kQoiDecoder;
+
+// loads the decoder stored in NVS
+void InitializeImageDecoder();
+// NULL if the decoder is not available on this target
+const ImageDecoder* GetImageDecoder(ImageDecoderType type);
+// the jpg decoder in use
+const ImageDecoder* ActiveImageDecoder();
+ImageDecoderType ActiveImageDecoderType();
+// picks the jpg decoder, takes effect from the next image and is kept in NVS
+bool SetImageDecoder(ImageDecoderType type);
+// by name, "jpegdec", "tjpgd" or "qoi" in any case. IMAGE_DECODER_COUNT if there is none of
+// that name, the decoder may still be missing on this target.
+ImageDecoderType ImageDecoderTypeFromName(const char* name);
+// decoder for the file, by its extension
+const ImageDecoder* ImageDecoderForPath(const char* path);
+
+// decodes the image opened in decoder, the time it takes goes into the stats of the decoder
+bool ImageDecoderDecode(const ImageDecoder* decoder, const ImageDecodeParams* params);
+// dual core decode of a jpg in memory that was opened in decoder. only JPEGDEC at full scale,
+// and only files with restart markers (DRI) on an MCU row boundary near the middle. the draw
+// callback is called from both cores, for disjoint rows.
+ImageSplitResult ImageDecoderDecodeSplit(const ImageDecoder* decoder, const uint8_t* data,
+                                         uint32_t size, const ImageDecodeParams* params);
+bool ImageDecodeClipBlock(ImageDecodeClip* clip, int x, int y, int w, int h,
+                          const uint16_t* pixels, int stride);
+// true if the jpg behind the stream is baseline with restart markers, the ones
+// ImageDecoderDecodeSplit() may split. reads the markers up to SOS only, so the file can be
+// streamed when it is false. the stream is left anywhere.
+bool JpegdecMaySplit(void* handle, ImageReadCallback read, ImageSeekCallback seek);
+// backend side of ImageDecoderDecodeSplit()
+ImageSplitResult JpegdecDecodeSplit(const uint8_t* data, uint32_t size, ImageDecodeClip* clip);
+
+void GetImageDecoderStats(ImageDecoderType type, ImageDecoderStats* stats);
+void LogImageDecoderStats();
+
+#ifdef __cplusplus
+}
+#endif
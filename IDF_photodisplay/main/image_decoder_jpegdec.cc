@@ -0,0 +1,411 @@
+#include <JPEGDEC.h>
+#include <string.h>
+#include <new>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "image_decoder.h"
+
+// split decode: the bottom part is decoded by a second instance in a task on the other core.
+// below the LVGL task priority, so animations keep their frame rate meanwhile.
+#define JPEG_SPLIT_TASK_STACK_SIZE (6 * 1024)
+#define JPEG_SPLIT_TASK_PRIORITY 1
+#define JPEG_SPLIT_TASK_CORE 0
+#define JPEG_SPLIT_MAX_SEGMENTS 16
+
+static const char* TAG = "JPEGDEC";
+
+// It requires about 17.5K of RAM, so it is only allocated once the backend is
+// used. Internally it does not allocate or free any memory.
+static JPEGDEC* jpeg_decoder_ = NULL;
+static ImageReadCallback stream_read_ = NULL;
+static ImageSeekCallback stream_seek_ = NULL;
+static ImageDecodeClip* clip_ = NULL;
+// rows of the framebuffer the decoders write to, 0 when they use their own buffer
+static int framebuffer_stride_ = 0;
+
+static bool AllocateJpegDecoder(JPEGDEC** decoder) {
+  if (*decoder != NULL) return true;
+  // internal RAM, the decoder tables are hit for every MCU
+  void* memory = heap_caps_malloc(sizeof(JPEGDEC), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (memory == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate the decoder");
+    return false;
+  }
+  *decoder = new (memory) JPEGDEC();
+  return true;
+}
+
+static int jpegdec_draw_callback(JPEGDRAW* pDraw) {
+  return ImageDecodeClipBlock(clip_, pDraw->x, pDraw->y, pDraw->iWidth, pDraw->iHeight,
+                              pDraw->pPixels,
+                              framebuffer_stride_ ? framebuffer_stride_ : pDraw->iWidth)
+             ? 1
+             : 0;
+}
+
+static int32_t jpegdec_read_callback(JPEGFILE* file, uint8_t* buffer, int32_t length) {
+  int32_t read_bytes = stream_read_(file->fHandle, buffer, length);
+  if (read_bytes > 0) file->iPos += read_bytes;
+  return read_bytes;
+}
+
+static int32_t jpegdec_seek_callback(JPEGFILE* file, int32_t position) {
+  if (!stream_seek_(file->fHandle, position)) return -1;
+  file->iPos = position;
+  return position;
+}
+
+// the caller owns the stream
+static void jpegdec_close_callback(void* handle) {}
+
+static bool JpegdecOpenMemory(const uint8_t* data, uint32_t size) {
+  return AllocateJpegDecoder(&jpeg_decoder_) &&
+         jpeg_decoder_->openRAM((uint8_t*)data, size, jpegdec_draw_callback);
+}
+
+static bool JpegdecOpenStream(void* handle, uint32_t size, ImageReadCallback read,
+                              ImageSeekCallback seek) {
+  stream_read_ = read;
+  stream_seek_ = seek;
+  return AllocateJpegDecoder(&jpeg_decoder_) &&
+         jpeg_decoder_->open(handle, size, jpegdec_close_callback, jpegdec_read_callback,
+                             jpegdec_seek_callback, jpegdec_draw_callback);
+}
+
+static uint16_t JpegdecWidth() { return jpeg_decoder_->getWidth(); }
+
+static uint16_t JpegdecHeight() { return jpeg_decoder_->getHeight(); }
+
+// JPEGDEC writes whole MCUs, so it only decodes straight into the framebuffer when the image is
+// a whole number of them (16 is the largest MCU) and the region is all of it
+static bool UsesFramebuffer(const ImageDecodeClip* clip, uint16_t width, uint16_t height) {
+  return clip->params->framebuffer != NULL && clip->params->scale_shift == 0 &&
+         width % 16 == 0 && height % 16 == 0 && clip->x0 == 0 && clip->y0 == 0 &&
+         clip->x1 == width && clip->y1 == height;
+}
+
+static bool RunJpegDecoder(JPEGDEC* decoder, const ImageDecodeParams* params,
+                           uint16_t* framebuffer) {
+  static const int scale_options[] = {0, JPEG_SCALE_HALF, JPEG_SCALE_QUARTER, JPEG_SCALE_EIGHTH};
+  // a full MCU row per draw call, so the strips are full width. without a framebuffer JPEGDEC
+  // caps it at what fits its own pixel buffer.
+  int mcu_width = (decoder->getSubSample() >> 4) == 2 ? 16 : 8;
+  decoder->setMaxOutputSize((decoder->getWidth() + mcu_width - 1) / mcu_width);
+  decoder->setFramebuffer(framebuffer);
+  decoder->setPixelType(params->format == IMAGE_PIXEL_RGB565_BE ? RGB565_BIG_ENDIAN
+                                                                : RGB565_LITTLE_ENDIAN);
+  // need to use JPEG_USES_DMA, other wise the image will have glitch
+  return decoder->decode(0, 0, JPEG_USES_DMA | scale_options[params->scale_shift & 3]);
+}
+
+static bool JpegdecDecode(ImageDecodeClip* clip) {
+  clip_ = clip;
+  uint16_t* framebuffer = NULL;
+  if (UsesFramebuffer(clip, JpegdecWidth(), JpegdecHeight())) {
+    framebuffer = clip->params->framebuffer;
+    framebuffer_stride_ = JpegdecWidth();
+  }
+  bool ret = RunJpegDecoder(jpeg_decoder_, clip->params, framebuffer);
+  framebuffer_stride_ = 0;
+  clip_ = NULL;
+  return ret;
+}
+
+static void JpegdecClose() { jpeg_decoder_->close(); }
+
+// split decode. with restart markers (DRI) the entropy data can be cut at a marker, as every
+// interval starts over with the DC predictions. when the cut is at an MCU row boundary, both
+// parts are complete jpgs once they get the tables and a SOF with their own height.
+// each part is read through a virtual file: the tables of the file, its slice of the entropy
+// data and an EOI marker, so only the tables are copied.
+typedef struct {
+  uint8_t* header;  // SOI, the tables and SOS, SOF patched to the height of the part
+  uint32_t header_size;
+  const uint8_t* data;  // entropy data slice
+  uint32_t data_size;
+} JpegSplitPart;
+
+typedef struct {
+  uint16_t width, height;
+  uint8_t mcu_width, mcu_height;
+  uint16_t restart_interval;
+  uint32_t segments[JPEG_SPLIT_MAX_SEGMENTS][2];  // offset and size of the segments to keep
+  int num_segments;
+  uint32_t header_size;  // SOI and the kept segments
+  uint32_t sof_offset;   // of the SOF segment in the header
+  uint32_t entropy_start;
+} JpegSplitLayout;
+
+static const uint8_t jpeg_eoi_[2] = {0xff, 0xd9};
+static JPEGDEC* split_decoder_ = NULL;
+static JpegSplitPart split_parts_[2];
+static ImageDecodeClip split_clip_;
+static int split_y_ = 0;
+static uint16_t* split_framebuffer_ = NULL;  // where the bottom part starts in the framebuffer
+static SemaphoreHandle_t split_start_ = NULL;
+static SemaphoreHandle_t split_done_ = NULL;
+static volatile bool split_ret_ = false;
+
+// baseline jpg with restart markers only, the APPn and COM segments are left out of the header
+static bool ParseJpegSplitLayout(const uint8_t* data, uint32_t size, JpegSplitLayout* layout) {
+  memset(layout, 0, sizeof(JpegSplitLayout));
+  if (size < 4 || data[0] != 0xff || data[1] != 0xd8) return false;
+  layout->header_size = 2;
+  uint32_t pos = 2;
+  while (pos + 4 <= size) {
+    if (data[pos] != 0xff) return false;
+    uint8_t marker = data[pos + 1];
+    if (marker == 0xff) {
+      pos++;
+      continue;
+    }
+    uint32_t length = (data[pos + 2] << 8) | data[pos + 3];
+    if (length < 2 || pos + 2 + length > size) return false;
+    const uint8_t* segment = data + pos + 4;
+    bool keep = true;
+    if (marker == 0xc0 || marker == 0xc1) {
+      if (length < 8) return false;
+      layout->sof_offset = layout->header_size;
+      layout->height = (segment[1] << 8) | segment[2];
+      layout->width = (segment[3] << 8) | segment[4];
+      int h_max = 1, v_max = 1;
+      for (uint32_t i = 0; i < segment[5] && 8 + 3 * (i + 1) <= length; i++) {
+        uint8_t sampling = segment[6 + 3 * i + 1];
+        if ((sampling >> 4) > h_max) h_max = sampling >> 4;
+        if ((sampling & 0x0f) > v_max) v_max = sampling & 0x0f;
+      }
+      layout->mcu_width = 8 * h_max;
+      layout->mcu_height = 8 * v_max;
+    } else if ((marker & 0xf0) == 0xc0 && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+      return false;  // progressive, lossless or arithmetic coded
+    } else if (marker == 0xdd) {
+      if (length < 4) return false;
+      layout->restart_interval = (segment[0] << 8) | segment[1];
+    } else if ((marker & 0xf0) == 0xe0 || marker == 0xfe) {
+      keep = false;
+    }
+    if (keep) {
+      if (layout->num_segments == JPEG_SPLIT_MAX_SEGMENTS) return false;
+      layout->segments[layout->num_segments][0] = pos;
+      layout->segments[layout->num_segments][1] = length + 2;
+      layout->num_segments++;
+      layout->header_size += length + 2;
+    }
+    pos += 2 + length;
+    if (marker == 0xda) {
+      layout->entropy_start = pos;
+      return layout->sof_offset > 0 && layout->restart_interval > 0;
+    }
+  }
+  return false;
+}
+
+bool JpegdecMaySplit(void* handle, ImageReadCallback read, ImageSeekCallback seek) {
+  uint8_t head[6];
+  if (read(handle, head, 2) != 2 || head[0] != 0xff || head[1] != 0xd8) return false;
+  uint32_t pos = 2;
+  bool baseline = false, restarts = false;
+  while (read(handle, head, 2) == 2 && head[0] == 0xff) {
+    uint8_t marker = head[1];
+    if (marker == 0xff) {
+      if (!seek(handle, ++pos)) return false;
+      continue;
+    }
+    // the tables come before SOS, so does DRI
+    if (marker == 0xda || read(handle, head + 2, 4) != 4) break;
+    uint32_t length = (head[2] << 8) | head[3];
+    if (length < 2) return false;
+    if (marker == 0xc0 || marker == 0xc1) {
+      baseline = true;
+    } else if ((marker & 0xf0) == 0xc0 && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+      return false;
+    } else if (marker == 0xdd && length >= 4) {
+      restarts = ((head[4] << 8) | head[5]) > 0;
+    }
+    pos += 2 + length;
+    if (!seek(handle, pos)) return false;
+  }
+  return baseline && restarts;
+}
+
+// offset of the n-th restart marker (1 based) in the entropy data, 0 if there is none
+static uint32_t FindRestartMarker(const uint8_t* data, uint32_t size, uint32_t start, uint32_t n) {
+  uint32_t count = 0;
+  const uint8_t* end = data + size - 1;
+  for (const uint8_t* p = data + start; p < end; p++) {
+    p = (const uint8_t*)memchr(p, 0xff, end - p);
+    if (p == NULL) return 0;
+    // 0xff00 is a stuffed 0xff, 0xffff a fill byte
+    if (p[1] >= 0xd0 && p[1] <= 0xd7) {
+      if (++count == n) return p - data;
+      p++;
+    } else if (p[1] == 0xd9) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+static void BuildJpegSplitHeader(const uint8_t* data, const JpegSplitLayout* layout,
+                                 uint16_t height, uint8_t* header) {
+  header[0] = 0xff;
+  header[1] = 0xd8;
+  uint32_t offset = 2;
+  for (int i = 0; i < layout->num_segments; i++) {
+    memcpy(header + offset, data + layout->segments[i][0], layout->segments[i][1]);
+    offset += layout->segments[i][1];
+  }
+  header[layout->sof_offset + 5] = height >> 8;
+  header[layout->sof_offset + 6] = height & 0xff;
+}
+
+static int32_t split_read_callback(JPEGFILE* file, uint8_t* buffer, int32_t length) {
+  JpegSplitPart* part = (JpegSplitPart*)file->fHandle;
+  uint32_t data_end = part->header_size + part->data_size;
+  int32_t read_bytes = 0;
+  while (length > 0) {
+    uint32_t pos = file->iPos;
+    const uint8_t* source;
+    uint32_t available;
+    if (pos < part->header_size) {
+      source = part->header + pos;
+      available = part->header_size - pos;
+    } else if (pos < data_end) {
+      source = part->data + pos - part->header_size;
+      available = data_end - pos;
+    } else if (pos < data_end + 2) {
+      source = jpeg_eoi_ + pos - data_end;
+      available = data_end + 2 - pos;
+    } else {
+      break;
+    }
+    uint32_t n = available < (uint32_t)length ? available : length;
+    memcpy(buffer, source, n);
+    buffer += n;
+    length -= n;
+    read_bytes += n;
+    file->iPos += n;
+  }
+  return read_bytes;
+}
+
+static int32_t split_seek_callback(JPEGFILE* file, int32_t position) {
+  file->iPos = position;
+  return position;
+}
+
+static int split_draw_callback(JPEGDRAW* pDraw) {
+  return ImageDecodeClipBlock(&split_clip_, pDraw->x, pDraw->y + split_y_, pDraw->iWidth,
+                              pDraw->iHeight, pDraw->pPixels,
+                              framebuffer_stride_ ? framebuffer_stride_ : pDraw->iWidth)
+             ? 1
+             : 0;
+}
+
+static void jpeg_split_task(void* arg) {
+  while (1) {
+    xSemaphoreTake(split_start_, portMAX_DELAY);
+    split_ret_ = RunJpegDecoder(split_decoder_, split_clip_.params, split_framebuffer_);
+    xSemaphoreGive(split_done_);
+  }
+}
+
+static bool StartJpegSplitTask() {
+  if (split_done_ != NULL) return true;
+  if (!AllocateJpegDecoder(&split_decoder_)) return false;
+  split_start_ = xSemaphoreCreateBinary();
+  SemaphoreHandle_t done = xSemaphoreCreateBinary();
+  if (split_start_ == NULL || done == NULL ||
+      xTaskCreatePinnedToCore(jpeg_split_task, "JpegSplit", JPEG_SPLIT_TASK_STACK_SIZE, NULL,
+                              JPEG_SPLIT_TASK_PRIORITY, NULL, JPEG_SPLIT_TASK_CORE) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start the split decode task");
+    return false;
+  }
+  split_done_ = done;
+  return true;
+}
+
+ImageSplitResult JpegdecDecodeSplit(const uint8_t* data, uint32_t size, ImageDecodeClip* clip) {
+  JpegSplitLayout layout;
+  if (clip->params->scale_shift != 0 || !ParseJpegSplitLayout(data, size, &layout)) {
+    return IMAGE_SPLIT_UNSUPPORTED;
+  }
+  // the cut has to be at a restart marker on an MCU row boundary, as close to the middle as
+  // possible. further off than a quarter of the rows and the second core hardly helps.
+  uint32_t mcus_per_row = (layout.width + layout.mcu_width - 1) / layout.mcu_width;
+  uint32_t rows = (layout.height + layout.mcu_height - 1) / layout.mcu_height;
+  uint32_t cut_row = 0;
+  for (uint32_t d = 0; d <= rows / 4 && cut_row == 0; d++) {
+    if ((rows / 2 - d) * mcus_per_row % layout.restart_interval == 0) {
+      cut_row = rows / 2 - d;
+    } else if ((rows / 2 + d) * mcus_per_row % layout.restart_interval == 0) {
+      cut_row = rows / 2 + d;
+    }
+  }
+  if (cut_row == 0 || cut_row >= rows) return IMAGE_SPLIT_UNSUPPORTED;
+  uint32_t marker = FindRestartMarker(data, size, layout.entropy_start,
+                                      cut_row * mcus_per_row / layout.restart_interval);
+  if (marker == 0 || !StartJpegSplitTask()) return IMAGE_SPLIT_UNSUPPORTED;
+  uint32_t entropy_end = size;
+  if (data[size - 2] == 0xff && data[size - 1] == 0xd9) entropy_end = size - 2;
+
+  uint8_t* headers = (uint8_t*)heap_caps_malloc(2 * layout.header_size,
+                                                MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (headers == NULL) return IMAGE_SPLIT_UNSUPPORTED;
+  split_y_ = cut_row * layout.mcu_height;
+  BuildJpegSplitHeader(data, &layout, split_y_, headers);
+  BuildJpegSplitHeader(data, &layout, layout.height - split_y_, headers + layout.header_size);
+  for (int i = 0; i < 2; i++) {
+    split_parts_[i].header = headers + i * layout.header_size;
+    split_parts_[i].header_size = layout.header_size;
+  }
+  split_parts_[0].data = data + layout.entropy_start;
+  split_parts_[0].data_size = marker - layout.entropy_start;
+  split_parts_[1].data = data + marker + 2;
+  split_parts_[1].data_size = entropy_end - marker - 2;
+
+  ImageSplitResult result = IMAGE_SPLIT_UNSUPPORTED;
+  clip_ = clip;
+  split_clip_ = *clip;
+  uint16_t* framebuffer = NULL;
+  split_framebuffer_ = NULL;
+  if (UsesFramebuffer(clip, layout.width, layout.height)) {
+    framebuffer = clip->params->framebuffer;
+    split_framebuffer_ = framebuffer + split_y_ * layout.width;
+    framebuffer_stride_ = layout.width;
+  }
+  if (jpeg_decoder_->open(&split_parts_[0],
+                          split_parts_[0].header_size + split_parts_[0].data_size + 2,
+                          jpegdec_close_callback, split_read_callback, split_seek_callback,
+                          jpegdec_draw_callback) &&
+      split_decoder_->open(&split_parts_[1],
+                           split_parts_[1].header_size + split_parts_[1].data_size + 2,
+                           jpegdec_close_callback, split_read_callback, split_seek_callback,
+                           split_draw_callback)) {
+    // top part here, bottom part on the other core, they write disjoint rows of the output
+    xSemaphoreGive(split_start_);
+    bool ret = RunJpegDecoder(jpeg_decoder_, clip->params, framebuffer);
+    xSemaphoreTake(split_done_, portMAX_DELAY);
+    split_decoder_->close();
+    result = ret && split_ret_ ? IMAGE_SPLIT_DECODED : IMAGE_SPLIT_FAILED;
+  } else {
+    // the open of the top part replaced the open file, the caller decodes the whole image in
+    // jpeg_decoder_ next
+    jpeg_decoder_->close();
+    if (!jpeg_decoder_->openRAM((uint8_t*)data, size, jpegdec_draw_callback)) {
+      result = IMAGE_SPLIT_FAILED;
+    }
+  }
+  framebuffer_stride_ = 0;
+  clip_ = NULL;
+  heap_caps_free(headers);
+  return result;
+}
+
+const ImageDecoder kJpegdecDecoder = {
+    "JPEGDEC",     JpegdecOpenMemory, JpegdecOpenStream, JpegdecWidth,
+    JpegdecHeight, JpegdecDecode,     JpegdecClose,
+};
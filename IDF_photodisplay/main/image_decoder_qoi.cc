@@ -0,0 +1,190 @@
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "image_decoder.h"
+
+// QOI, see https://qoiformat.org/qoi-specification.pdf
+#define QOI_MAGIC 0x716f6966  // "qoif"
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+#define QOI_MASK_2 0xc0
+// streams are pulled through this buffer, the byte oriented decode reads it one byte at a time
+#define QOI_READ_BUFFER_SIZE (4 * 1024)
+// rows converted to RGB565 before they are handed to the draw callback
+#define QOI_STRIP_LINES 16
+
+static const char* TAG = "QOI";
+
+static const uint8_t* input_ = NULL;
+static uint32_t input_size_ = 0;
+static uint32_t input_pos_ = 0;
+static uint8_t* read_buffer_ = NULL;
+static void* stream_handle_ = NULL;
+static ImageReadCallback stream_read_ = NULL;
+
+static uint32_t width_ = 0, height_ = 0;
+static uint16_t* strip_ = NULL;
+static uint32_t strip_size_ = 0;
+
+static bool RefillInput() {
+  if (stream_read_ == NULL) return false;
+  int32_t read_bytes = stream_read_(stream_handle_, read_buffer_, QOI_READ_BUFFER_SIZE);
+  if (read_bytes <= 0) return false;
+  input_ = read_buffer_;
+  input_size_ = read_bytes;
+  input_pos_ = 0;
+  return true;
+}
+
+static inline bool NextByte(uint8_t* value) {
+  if (input_pos_ >= input_size_ && !RefillInput()) return false;
+  *value = input_[input_pos_++];
+  return true;
+}
+
+static bool ReadHeader() {
+  uint8_t header[14];
+  for (int i = 0; i < 14; i++) {
+    if (!NextByte(&header[i])) return false;
+  }
+  uint32_t magic = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+  width_ = (header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+  height_ = (header[8] << 24) | (header[9] << 16) | (header[10] << 8) | header[11];
+  if (magic != QOI_MAGIC || width_ == 0 || height_ == 0 || width_ > 0xffff || height_ > 0xffff ||
+      (header[12] != 3 && header[12] != 4)) {
+    ESP_LOGE(TAG, "not a qoi image");
+    return false;
+  }
+  return true;
+}
+
+static bool QoiOpenMemory(const uint8_t* data, uint32_t size) {
+  input_ = data;
+  input_size_ = size;
+  input_pos_ = 0;
+  stream_read_ = NULL;
+  return ReadHeader();
+}
+
+static bool QoiOpenStream(void* handle, uint32_t size, ImageReadCallback read,
+                          ImageSeekCallback seek) {
+  if (read_buffer_ == NULL) {
+    read_buffer_ =
+        (uint8_t*)heap_caps_malloc(QOI_READ_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (read_buffer_ == NULL) return false;
+  }
+  input_ = read_buffer_;
+  input_size_ = 0;
+  input_pos_ = 0;
+  stream_handle_ = handle;
+  stream_read_ = read;
+  return ReadHeader();
+}
+
+static uint16_t QoiWidth() { return width_; }
+
+static uint16_t QoiHeight() { return height_; }
+
+static bool QoiDecode(ImageDecodeClip* clip) {
+  int shift = clip->params->scale_shift & 3;
+  uint32_t mask = (1 << shift) - 1;
+  uint32_t out_width = (width_ + mask) >> shift;
+  uint32_t out_height = (height_ + mask) >> shift;
+  // whole image regions are decoded straight into the framebuffer if there is one
+  uint16_t* framebuffer = clip->x0 == 0 && clip->y0 == 0 && clip->x1 == (int)out_width &&
+                                  clip->y1 == (int)out_height
+                              ? clip->params->framebuffer
+                              : NULL;
+  if (framebuffer == NULL && strip_size_ < out_width * QOI_STRIP_LINES) {
+    heap_caps_free(strip_);
+    strip_size_ = out_width * QOI_STRIP_LINES;
+    strip_ = (uint16_t*)heap_caps_malloc(strip_size_ * 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (strip_ == NULL) {
+      strip_size_ = 0;
+      ESP_LOGE(TAG, "Failed to allocate the strip buffer");
+      return false;
+    }
+  }
+  bool big_endian = clip->params->format == IMAGE_PIXEL_RGB565_BE;
+
+  uint8_t index[64][4];
+  memset(index, 0, sizeof(index));
+  uint8_t r = 0, g = 0, b = 0, a = 255;
+  uint32_t run = 0;
+  uint32_t strip_y = 0, strip_lines = 0;
+  for (uint32_t y = 0; y < height_; y++) {
+    // downscaling keeps every (1 << shift)-th pixel, the whole stream still has to be parsed
+    bool keep_row = (y & mask) == 0;
+    uint16_t* strip = framebuffer ? framebuffer + strip_y * out_width : strip_;
+    uint16_t* out = strip + strip_lines * out_width;
+    for (uint32_t x = 0; x < width_; x++) {
+      if (run > 0) {
+        run--;
+      } else {
+        uint8_t b1, b2;
+        if (!NextByte(&b1)) goto truncated;
+        if (b1 == QOI_OP_RGB) {
+          if (!NextByte(&r) || !NextByte(&g) || !NextByte(&b)) goto truncated;
+        } else if (b1 == QOI_OP_RGBA) {
+          if (!NextByte(&r) || !NextByte(&g) || !NextByte(&b) || !NextByte(&a)) goto truncated;
+        } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+          r = index[b1][0];
+          g = index[b1][1];
+          b = index[b1][2];
+          a = index[b1][3];
+        } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+          r += ((b1 >> 4) & 0x03) - 2;
+          g += ((b1 >> 2) & 0x03) - 2;
+          b += (b1 & 0x03) - 2;
+        } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+          if (!NextByte(&b2)) goto truncated;
+          int vg = (b1 & 0x3f) - 32;
+          r += vg - 8 + ((b2 >> 4) & 0x0f);
+          g += vg;
+          b += vg - 8 + (b2 & 0x0f);
+        } else {
+          run = b1 & 0x3f;
+        }
+        uint8_t* entry = index[(r * 3 + g * 5 + b * 7 + a * 11) & 63];
+        entry[0] = r;
+        entry[1] = g;
+        entry[2] = b;
+        entry[3] = a;
+      }
+      if (keep_row && (x & mask) == 0) {
+        uint16_t pixel = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+        out[x >> shift] = big_endian ? (pixel >> 8) | (pixel << 8) : pixel;
+      }
+    }
+    if (keep_row && ++strip_lines == QOI_STRIP_LINES) {
+      if (!ImageDecodeClipBlock(clip, 0, strip_y, out_width, strip_lines, strip, out_width)) {
+        return false;
+      }
+      strip_y += strip_lines;
+      strip_lines = 0;
+    }
+  }
+  return strip_lines == 0 ||
+         ImageDecodeClipBlock(clip, 0, strip_y, out_width, strip_lines,
+                              framebuffer ? framebuffer + strip_y * out_width : strip_, out_width);
+
+truncated:
+  ESP_LOGE(TAG, "image data is truncated");
+  return false;
+}
+
+static void QoiClose() {
+  input_ = NULL;
+  input_size_ = 0;
+  stream_handle_ = NULL;
+  stream_read_ = NULL;
+}
+
+const ImageDecoder kQoiDecoder = {
+    "QOI",     QoiOpenMemory, QoiOpenStream, QoiWidth,
+    QoiHeight, QoiDecode,     QoiClose,
+};
@@ -0,0 +1,115 @@
+#include "image_decoder.h"
+#if CONFIG_ESP_ROM_HAS_JPEG_DECODE
+#include <string.h>
+#include "esp32s3/rom/tjpgd.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+// work area of jd_prepare(), enough for the tables of any baseline jpg
+#define TJPGD_WORK_SIZE 3100
+// the ROM decoder outputs one MCU at a time, at most 16x16
+#define TJPGD_MAX_MCU_PIXELS (16 * 16)
+
+static const char* TAG = "TJPGD";
+
+static JDEC jdec_;
+static void* work_ = NULL;
+static uint16_t mcu_pixels_[TJPGD_MAX_MCU_PIXELS];
+
+static const uint8_t* memory_data_ = NULL;
+static uint32_t memory_size_ = 0;
+static void* stream_handle_ = NULL;
+static ImageReadCallback stream_read_ = NULL;
+static ImageSeekCallback stream_seek_ = NULL;
+static uint32_t position_ = 0;
+static ImageDecodeClip* clip_ = NULL;
+
+// input function of TJpgDec, a NULL buffer means skip length bytes
+static uint32_t tjpgd_input(JDEC* jd, uint8_t* buffer, uint32_t length) {
+  if (stream_read_ == NULL) {
+    if (length > memory_size_ - position_) length = memory_size_ - position_;
+    if (buffer) memcpy(buffer, memory_data_ + position_, length);
+    position_ += length;
+    return length;
+  }
+  if (buffer == NULL) {
+    if (!stream_seek_(stream_handle_, position_ + length)) return 0;
+    position_ += length;
+    return length;
+  }
+  int32_t read_bytes = stream_read_(stream_handle_, buffer, length);
+  if (read_bytes <= 0) return 0;
+  position_ += read_bytes;
+  return read_bytes;
+}
+
+// output function of TJpgDec, gets one MCU of RGB888
+static uint32_t tjpgd_output(JDEC* jd, void* bitmap, JRECT* rect) {
+  int w = rect->right - rect->left + 1;
+  int h = rect->bottom - rect->top + 1;
+  const uint8_t* rgb = (const uint8_t*)bitmap;
+  bool big_endian = clip_->params->format == IMAGE_PIXEL_RGB565_BE;
+  for (int i = 0; i < w * h; i++, rgb += 3) {
+    uint16_t pixel = ((rgb[0] & 0xf8) << 8) | ((rgb[1] & 0xfc) << 3) | (rgb[2] >> 3);
+    mcu_pixels_[i] = big_endian ? (pixel >> 8) | (pixel << 8) : pixel;
+  }
+  return ImageDecodeClipBlock(clip_, rect->left, rect->top, w, h, mcu_pixels_, w) ? 1 : 0;
+}
+
+static bool TjpgdPrepare() {
+  if (work_ == NULL) {
+    work_ = heap_caps_malloc(TJPGD_WORK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (work_ == NULL) {
+      ESP_LOGE(TAG, "Failed to allocate the work area");
+      return false;
+    }
+  }
+  position_ = 0;
+  JRESULT result = jd_prepare(&jdec_, tjpgd_input, work_, TJPGD_WORK_SIZE, NULL);
+  if (result != JDR_OK) {
+    ESP_LOGE(TAG, "jd_prepare failed: %d", result);
+    return false;
+  }
+  return true;
+}
+
+static bool TjpgdOpenMemory(const uint8_t* data, uint32_t size) {
+  memory_data_ = data;
+  memory_size_ = size;
+  stream_read_ = NULL;
+  return TjpgdPrepare();
+}
+
+static bool TjpgdOpenStream(void* handle, uint32_t size, ImageReadCallback read,
+                            ImageSeekCallback seek) {
+  stream_handle_ = handle;
+  stream_read_ = read;
+  stream_seek_ = seek;
+  return TjpgdPrepare();
+}
+
+static uint16_t TjpgdWidth() { return jdec_.width; }
+
+static uint16_t TjpgdHeight() { return jdec_.height; }
+
+static bool TjpgdDecode(ImageDecodeClip* clip) {
+  clip_ = clip;
+  JRESULT result = jd_decomp(&jdec_, tjpgd_output, clip->params->scale_shift & 3);
+  clip_ = NULL;
+  // JDR_INTR is the draw callback stopping the decode
+  if (result != JDR_OK && result != JDR_INTR) ESP_LOGE(TAG, "jd_decomp failed: %d", result);
+  return result == JDR_OK;
+}
+
+static void TjpgdClose() {
+  memory_data_ = NULL;
+  stream_handle_ = NULL;
+  stream_read_ = NULL;
+  stream_seek_ = NULL;
+}
+
+const ImageDecoder kTjpgdDecoder = {
+    "TJPGD",     TjpgdOpenMemory, TjpgdOpenStream, TjpgdWidth,
+    TjpgdHeight, TjpgdDecode,     TjpgdClose,
+};
+#endif
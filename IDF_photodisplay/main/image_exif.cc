@@ -0,0 +1,113 @@
+#include "image_exif.h"
+#include <string.h>
+
+#define EXIF_TAG_ORIENTATION 0x0112
+#define EXIF_TYPE_SHORT 3
+
+static uint16_t Read16(const uint8_t* p, bool little_endian) {
+  return little_endian ? p[0] | (p[1] << 8) : (p[0] << 8) | p[1];
+}
+
+static uint32_t Read32(const uint8_t* p, bool little_endian) {
+  return little_endian ? p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24)
+                       : ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static bool IsExif(const uint8_t* data, uint32_t size) {
+  return size >= 6 && memcmp(data, "Exif\0\0", 6) == 0;
+}
+
+// the payload of an APP1 segment (after the length), which may be cut short
+static uint8_t ParseExifSegment(const uint8_t* data, uint32_t size) {
+  if (size < 6 + 8 || !IsExif(data, size)) return IMAGE_ORIENTATION_UPRIGHT;
+  const uint8_t* tiff = data + 6;
+  uint32_t tiff_size = size - 6;
+  bool little_endian = tiff[0] == 'I' && tiff[1] == 'I';
+  if (!little_endian && !(tiff[0] == 'M' && tiff[1] == 'M')) return IMAGE_ORIENTATION_UPRIGHT;
+  if (Read16(tiff + 2, little_endian) != 42) return IMAGE_ORIENTATION_UPRIGHT;
+
+  uint32_t ifd = Read32(tiff + 4, little_endian);
+  if (ifd > tiff_size - 2) return IMAGE_ORIENTATION_UPRIGHT;
+  uint32_t entries = Read16(tiff + ifd, little_endian);
+  for (uint32_t i = 0; i < entries; i++) {
+    uint32_t entry = ifd + 2 + i * 12;
+    if (entry + 12 > tiff_size) break;
+    if (Read16(tiff + entry, little_endian) != EXIF_TAG_ORIENTATION) continue;
+    if (Read16(tiff + entry + 2, little_endian) != EXIF_TYPE_SHORT) break;
+    uint16_t orientation = Read16(tiff + entry + 8, little_endian);
+    return orientation >= 1 && orientation <= 8 ? orientation : IMAGE_ORIENTATION_UPRIGHT;
+  }
+  return IMAGE_ORIENTATION_UPRIGHT;
+}
+
+// TEM and RSTn have no length
+static bool IsStandalone(uint8_t marker) {
+  return marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7);
+}
+
+// no APP1 comes after a start of frame (DHT, JPG and DAC share its range), a start of scan or
+// the end of the image
+static bool EndsHeader(uint8_t marker) {
+  if (marker >= 0xc0 && marker <= 0xcf) return marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+  return marker == 0xda || marker == 0xd9;
+}
+
+uint8_t ImageExifOrientation(const uint8_t* data, uint32_t size) {
+  if (size < 4 || data[0] != 0xff || data[1] != 0xd8) return IMAGE_ORIENTATION_UPRIGHT;
+  uint32_t pos = 2;
+  while (pos + 4 <= size) {
+    if (data[pos] != 0xff) break;
+    uint8_t marker = data[pos + 1];
+    if (marker == 0xff) {
+      // fill byte
+      pos++;
+      continue;
+    }
+    if (IsStandalone(marker)) {
+      pos += 2;
+      continue;
+    }
+    if (EndsHeader(marker)) break;
+    uint32_t length = (data[pos + 2] << 8) | data[pos + 3];
+    if (length < 2) break;
+    uint32_t available = size - pos - 4;
+    if (length - 2 < available) available = length - 2;
+    // XMP is an APP1 segment too
+    if (marker == 0xe1 && IsExif(data + pos + 4, available)) {
+      return ParseExifSegment(data + pos + 4, available);
+    }
+    pos += 2 + length;
+  }
+  return IMAGE_ORIENTATION_UPRIGHT;
+}
+
+uint8_t ImageExifOrientationStream(void* handle, ImageReadCallback read, ImageSeekCallback seek) {
+  uint8_t head[4];
+  if (read(handle, head, 2) != 2 || head[0] != 0xff || head[1] != 0xd8) {
+    return IMAGE_ORIENTATION_UPRIGHT;
+  }
+  uint32_t pos = 2;
+  while (read(handle, head, 2) == 2 && head[0] == 0xff) {
+    uint8_t marker = head[1];
+    if (marker == 0xff) {
+      // fill byte, the second one may be the start of the marker
+      if (!seek(handle, ++pos)) break;
+      continue;
+    }
+    pos += 2;
+    if (IsStandalone(marker)) continue;
+    if (EndsHeader(marker) || read(handle, head + 2, 2) != 2) break;
+    uint32_t length = (head[2] << 8) | head[3];
+    if (length < 2) break;
+    if (marker == 0xe1) {
+      uint8_t segment[IMAGE_EXIF_READ_SIZE];
+      int32_t wanted = length - 2 < IMAGE_EXIF_READ_SIZE ? length - 2 : IMAGE_EXIF_READ_SIZE;
+      int32_t got = read(handle, segment, wanted);
+      // XMP is an APP1 segment too
+      if (got > 0 && IsExif(segment, got)) return ParseExifSegment(segment, got);
+    }
+    pos += length;
+    if (!seek(handle, pos)) break;
+  }
+  return IMAGE_ORIENTATION_UPRIGHT;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include "image_decoder.h"
+
+// EXIF orientation of a jpg, read from the Orientation tag of IFD0 in the APP1 segment.
+// 1 is upright, 2 ~ 8 are the mirrored and rotated ones, 5 ~ 8 swap width and height:
+//   1 as is          2 mirrored horizontally   3 rotated 180          4 mirrored vertically
+//   5 transposed     6 rotated 90 clockwise    7 transversed          8 rotated 90 counterclockwise
+#define IMAGE_ORIENTATION_UPRIGHT 1
+// the part of the APP1 segment that is read from streams, IFD0 comes first and Orientation is
+// one of its first tags
+#define IMAGE_EXIF_READ_SIZE 512
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// both return IMAGE_ORIENTATION_UPRIGHT when the jpg has no (valid) orientation tag
+uint8_t ImageExifOrientation(const uint8_t* data, uint32_t size);
+// reads the markers from the start of the stream, the position is left anywhere
+uint8_t ImageExifOrientationStream(void* handle, ImageReadCallback read, ImageSeekCallback seek);
+
+static inline bool ImageOrientationTransposed(uint8_t orientation) { return orientation >= 5; }
+
+#ifdef __cplusplus
+}
+#endif
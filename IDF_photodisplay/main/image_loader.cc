@@ -1,18 +1,32 @@
 
 #include "image_loader.h"
-#include <JPEGDEC.h>
+#include <assert.h>
 #include <errno.h>
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "frame_cache.h"
+#include "frame_tiles.h"
+#include "image_decoder.h"
+#include "image_exif.h"
+#include "image_sidecar.h"
+#include "latency_stats.h"
+#include "photo_pack.h"
+#include "photo_store.h"
+#include "rgb565.h"
 #include "sdmmc_driver.h"
 
-#define JPG_FILE_BUFFER_SIZE 200000
-#define JPG_IMAGE_BUFFER_SIZE (400 * 450)
-#define MAXOUTPUTSIZE 103
+// stdio buffer for streaming decode, JPEGDEC itself reads the file in small chunks
+#define JPG_STREAM_READ_BUFFER_SIZE (16 * 1024)
+#define JPG_FRAME_BUFFER_COUNT (IMAGE_PREFETCH_DEPTH + 1)
+// the preview frame comes after the ring in jpg_frames_
+#define JPG_PREVIEW_FRAME JPG_FRAME_BUFFER_COUNT
+// longer side of the screen, the fit of a rotated photo can be that wide
+#define SCREEN_MAX_SIDE \
+  (EXAMPLE_LCD_H_RES > EXAMPLE_LCD_V_RES ? EXAMPLE_LCD_H_RES : EXAMPLE_LCD_V_RES)
 
 static const char* TAG = "IMAGE";
 
-static int32_t current_image_id_ = 0;
-
 FILE* SdmmcOpenFile(const char* file_path) {
   FILE* fp = fopen(file_path, "rb");
   if (fp == NULL) {
@@ -26,9 +40,20 @@ static bool OpenJpgImage(const char* file_path) {
   if (fp_timebg_ != NULL) {
     fclose(fp_timebg_);
   }
+  int64_t start_us = esp_timer_get_time();
   fp_timebg_ = SdmmcOpenFile(file_path);
+  LatencyRecord(LATENCY_STAGE_OPEN, esp_timer_get_time() - start_us);
+#if IMAGE_LOADER_STREAM_DECODE
+  // before the first read, the split check may read the header ahead of the streaming decode
+  if (fp_timebg_ != NULL) setvbuf(fp_timebg_, NULL, _IOFBF, JPG_STREAM_READ_BUFFER_SIZE);
+#endif
   return fp_timebg_ != NULL;
 }
+static long JpgFileSize() {
+  if (fp_timebg_ == NULL || fseek(fp_timebg_, 0, SEEK_END) != 0) return -1;
+  return ftell(fp_timebg_);
+}
+
 static size_t ReadTimeBGFrameToBuffer(uint8_t* data_buffer) {
   if (data_buffer == NULL) return 0;
   if (fp_timebg_ == NULL) return 0;
@@ -39,104 +64,983 @@ static size_t ReadTimeBGFrameToBuffer(uint8_t* data_buffer) {
     ESP_LOGE(TAG, "[SD ERROR] Failed to seek 0 in file");
     return 0;
   }
+  // ftell() returns -1 on failure
+  if (filesize <= 0 || filesize > JPG_FILE_BUFFER_SIZE) {
+    ESP_LOGE(TAG, "[SD ERROR] File size %ld is empty, unknown or exceeds the jpg file buffer",
+             filesize);
+    fclose(fp_timebg_);
+    fp_timebg_ = NULL;
+    return 0;
+  }
 
-  size_t read_bytes = fread((char*)data_buffer, 1, filesize, fp_timebg_);
+  int64_t start_us = esp_timer_get_time();
+  size_t read_bytes = fread((char*)data_buffer, 1, (size_t)filesize, fp_timebg_);
+  LatencyRecord(LATENCY_STAGE_READ, esp_timer_get_time() - start_us);
   fclose(fp_timebg_);
   fp_timebg_ = NULL;
-  if (read_bytes != filesize) {
-    ESP_LOGE(TAG, "[SD ERROR] Failed to read %lu %u in file", filesize, read_bytes);
+  if (read_bytes != (size_t)filesize) {
+    ESP_LOGE(TAG, "[SD ERROR] Failed to read %ld %zu in file", filesize, read_bytes);
     return 0;
   }
   return read_bytes;
 }
 
-// Static instance of the JPEGDEC structure. It requires about
-// 17.5K of RAM. You can allocate it dynamically too. Internally it
-// does not allocate or free any memory; all memory management decisions
-// are left to you
-JPEGDEC jpeg_decoder_;
-
 static uint8_t* jpg_file_buffer_;
-static uint16_t* jpg_image_buffer_;
 static uint16_t jpg_width_ = 0, jpg_height_ = 0;
+
+// EXIF orientation of the image being decoded. decodes run in the orientation the image is
+// stored in, planned against the screen turned the same way, and their blocks are written
+// rotated or mirrored into the frame, so the frame ends up upright without a second pass.
+static uint8_t orientation_ = IMAGE_ORIENTATION_UPRIGHT;
+static uint32_t screen_width_ = EXAMPLE_LCD_H_RES, screen_height_ = EXAMPLE_LCD_V_RES;
+
+// where pixel (x, y) of the decode lands in the frame: origin + x * step_x + y * step_y
+typedef struct {
+  int32_t origin, step_x, step_y;
+} FrameMapping;
+static FrameMapping frame_mapping_;
+
+static void SetImageOrientation(uint8_t orientation) {
+  orientation_ = orientation;
+  bool transposed = ImageOrientationTransposed(orientation);
+  screen_width_ = transposed ? EXAMPLE_LCD_V_RES : EXAMPLE_LCD_H_RES;
+  screen_height_ = transposed ? EXAMPLE_LCD_H_RES : EXAMPLE_LCD_V_RES;
+}
+
+// mapping of a width x height decode, the frame is height pixels wide for the transposed ones
+static FrameMapping OrientFrame(uint8_t orientation, int32_t width, int32_t height) {
+  switch (orientation) {
+    case 2:  // mirrored horizontally
+      return {width - 1, -1, width};
+    case 3:  // rotated 180
+      return {height * width - 1, -1, -width};
+    case 4:  // mirrored vertically
+      return {(height - 1) * width, 1, -width};
+    case 5:  // transposed
+      return {0, height, 1};
+    case 6:  // rotated 90 clockwise
+      return {height - 1, height, -1};
+    case 7:  // transversed
+      return {width * height - 1, -height, -1};
+    case 8:  // rotated 90 counterclockwise
+      return {(width - 1) * height, -height, 1};
+    default:
+      return {0, 1, width};
+  }
+}
+
+// copies a decoded block into the frame through frame_mapping_
+static void WriteOrientedBlock(uint16_t* frame, int x, int y, int w, int h,
+                               const uint16_t* pixels, int stride) {
+  const FrameMapping* map = &frame_mapping_;
+  uint16_t* origin = frame + map->origin + x * map->step_x + y * map->step_y;
+  if (map->step_x == 1 || map->step_x == -1) {
+    // rows stay rows
+    for (int j = 0; j < h; j++) {
+      uint16_t* dst = origin + j * map->step_y;
+      const uint16_t* src = pixels + j * stride;
+      for (int i = 0; i < w; i++) dst[i * map->step_x] = src[i];
+    }
+  } else {
+    // block columns become frame rows, walk the block by columns so the frame is written in runs
+    for (int i = 0; i < w; i++) {
+      uint16_t* dst = origin + i * map->step_x;
+      const uint16_t* src = pixels + i;
+      for (int j = 0; j < h; j++) dst[j * map->step_y] = src[j * stride];
+    }
+  }
+}
+
+// set when the image being decoded is no longer needed, makes the draw callback stop the decoder
+static volatile bool decode_abort_ = false;
+// direct_to_panel_requested_ asks for the next decode to also be pushed to the panel, which
+// only happens for full screen images (direct_to_panel_ tells if the last decode did so).
+static bool direct_to_panel_requested_ = false;
+static bool direct_to_panel_ = false;
 static uint16_t* jpg_image_buffer_read_tmp_ = NULL;
-static int jpg_to_memory_callback(JPEGDRAW* pDraw) {
-  if (!jpg_image_buffer_read_tmp_) return 0;
-  for (int j = 0; j < pDraw->iHeight; j++) {
-    memcpy(jpg_image_buffer_read_tmp_ + (pDraw->y + j) * jpg_width_ + pDraw->x,
-           pDraw->pPixels + j * pDraw->iWidth, pDraw->iWidth * 2);
+static bool jpg_to_memory_callback(void* user, int x, int y, int w, int h, const uint16_t* pixels,
+                                   int stride) {
+  if (!jpg_image_buffer_read_tmp_ || decode_abort_) return false;
+  if (orientation_ != IMAGE_ORIENTATION_UPRIGHT) {
+    // never the framebuffer or the panel
+    WriteOrientedBlock(jpg_image_buffer_read_tmp_, x, y, w, h, pixels, stride);
+    return true;
+  }
+  uint16_t* dst = jpg_image_buffer_read_tmp_ + y * jpg_width_ + x;
+  // decoders writing straight into the frame (params.framebuffer) hand over pointers into it
+  if (pixels != dst) {
+    if (x == 0 && w == jpg_width_ && stride == w) {
+      // full width strip, one contiguous transfer
+      memcpy(dst, pixels, w * h * 2);
+    } else {
+      for (int j = 0; j < h; j++) memcpy(dst + j * jpg_width_, pixels + j * stride, w * 2);
+    }
+  }
+  // whole image decodes hand over contiguous blocks (stride == w)
+  if (direct_to_panel_) DisplayDrawStrip(x, y, w, h, pixels);
+  return true;
+}
+
+// images larger than the screen are decoded at the decoder scale that lands at or just above the
+// size that fits the screen, then box filtered down to it. the decoder hands over bands of rows,
+// the rows an output row still needs are kept in rows (row 0 is source row rows_y).
+#define BOX_FILTER_MAX_BAND_LINES 16
+typedef struct {
+  uint32_t src_width, src_height;  // after the decoder scale
+  uint16_t* rows;
+  uint32_t rows_capacity;
+  uint32_t rows_y;
+  uint32_t rows_filled;  // complete rows, the band being received comes after them
+  uint32_t band_y, band_height;
+  uint32_t out_y;  // next output row
+  uint16_t x_start[SCREEN_MAX_SIDE + 1];  // first source column of each output column
+} BoxFilter;
+static BoxFilter box_;
+
+// averages the output rows that have all their source rows, then drops the rows not needed
+static void BoxFilterEmitRows() {
+  while (box_.out_y < jpg_height_) {
+    uint32_t y0 = box_.out_y * box_.src_height / jpg_height_;
+    uint32_t y1 = (box_.out_y + 1) * box_.src_height / jpg_height_;
+    if (y1 > box_.rows_y + box_.rows_filled) break;
+    uint16_t* out = jpg_image_buffer_read_tmp_ + frame_mapping_.origin +
+                    (int32_t)box_.out_y * frame_mapping_.step_y;
+    for (int ox = 0; ox < jpg_width_; ox++) {
+      uint32_t x0 = box_.x_start[ox], x1 = box_.x_start[ox + 1];
+      uint32_t r = 0, g = 0, b = 0;
+      for (uint32_t y = y0; y < y1; y++) {
+        const uint16_t* row = box_.rows + (y - box_.rows_y) * box_.src_width;
+        for (uint32_t x = x0; x < x1; x++) {
+          r += row[x] >> 11;
+          g += (row[x] >> 5) & 0x3f;
+          b += row[x] & 0x1f;
+        }
+      }
+      uint32_t count = (y1 - y0) * (x1 - x0);
+      uint16_t pixel = ((r / count) << 11) | ((g / count) << 5) | (b / count);
+      out[ox * frame_mapping_.step_x] = (pixel >> 8) | (pixel << 8);
+    }
+    box_.out_y++;
+  }
+  uint32_t drop = box_.out_y * box_.src_height / jpg_height_ - box_.rows_y;
+  if (drop > box_.rows_filled) drop = box_.rows_filled;
+  if (drop == 0) return;
+  memmove(box_.rows, box_.rows + drop * box_.src_width,
+          (box_.rows_filled - drop) * box_.src_width * 2);
+  box_.rows_y += drop;
+  box_.rows_filled -= drop;
+}
+
+static bool box_filter_callback(void* user, int x, int y, int w, int h, const uint16_t* pixels,
+                                int stride) {
+  if (!jpg_image_buffer_read_tmp_ || decode_abort_) return false;
+  if ((uint32_t)y != box_.band_y) {
+    // blocks come in bands from the top, a new band completes the previous one
+    box_.rows_filled += box_.band_height;
+    BoxFilterEmitRows();
+    box_.band_y = y;
+  }
+  box_.band_height = h;
+  if (y - box_.rows_y + h > box_.rows_capacity) return false;
+  uint16_t* dst = box_.rows + (y - box_.rows_y) * box_.src_width + x;
+  for (int j = 0; j < h; j++) {
+    memcpy(dst + j * box_.src_width, pixels + j * stride, w * 2);
+  }
+  return true;
+}
+
+// the size an image larger than the screen is scaled to, keeping the aspect ratio
+static void FitScreen(uint16_t width, uint16_t height, uint32_t* fit_width,
+                      uint32_t* fit_height) {
+  *fit_width = screen_width_;
+  *fit_height = screen_height_;
+  if ((uint32_t)width * screen_height_ >= (uint32_t)height * screen_width_) {
+    *fit_height = (uint32_t)height * screen_width_ / width;
+  } else {
+    *fit_width = (uint32_t)width * screen_height_ / height;
+  }
+  if (*fit_width == 0) *fit_width = 1;
+  if (*fit_height == 0) *fit_height = 1;
+}
+
+// photos that cover the screen and are at most KEN_BURNS_MAX_* are kept at full size for the
+// pan, width and height as shown
+static bool KeepFullSize(uint16_t width, uint16_t height) {
+#if IMAGE_LOADER_KEN_BURNS
+  return width >= EXAMPLE_LCD_H_RES && height >= EXAMPLE_LCD_V_RES &&
+         width <= KEN_BURNS_MAX_WIDTH && height <= KEN_BURNS_MAX_HEIGHT;
+#else
+  return false;
+#endif
+}
+
+// picks the decoder scale for an image larger than the screen and sets jpg_width_ and
+// jpg_height_ to the size it is shown at, returns false if it cannot be shown.
+static bool PlanScaledDecode(uint16_t width, uint16_t height, ImageDecodeParams* params) {
+  uint32_t fit_width, fit_height;
+  FitScreen(width, height, &fit_width, &fit_height);
+
+  uint32_t src_width = width, src_height = height;
+  for (int shift = 1; shift <= 3; shift++) {
+    uint32_t round = (1 << shift) - 1;
+    uint32_t scaled_width = (width + round) >> shift, scaled_height = (height + round) >> shift;
+#if IMAGE_LOADER_BOX_FILTER
+    if (scaled_width < fit_width || scaled_height < fit_height) break;
+#endif
+    params->scale_shift = shift;
+    src_width = scaled_width;
+    src_height = scaled_height;
+#if !IMAGE_LOADER_BOX_FILTER
+    if (src_width <= screen_width_ && src_height <= screen_height_) break;
+#endif
+  }
+  if (src_width <= screen_width_ && src_height <= screen_height_) {
+    jpg_width_ = src_width;
+    jpg_height_ = src_height;
+    return true;
+  }
+#if IMAGE_LOADER_BOX_FILTER
+  jpg_width_ = fit_width;
+  jpg_height_ = fit_height;
+  box_.src_width = src_width;
+  box_.src_height = src_height;
+  box_.rows_capacity = BOX_FILTER_MAX_BAND_LINES + src_height / fit_height + 1;
+  box_.rows = (uint16_t*)heap_caps_malloc(box_.rows_capacity * src_width * 2,
+                                          MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (box_.rows == NULL) {
+    ESP_LOGE(TAG, "[MEME] Failed to allocate the box filter rows");
+    return false;
   }
-  return 1;  // returning true (1) tells JPEGDEC to continue decoding. Returning
-             // false (0) would quit decoding immediately.
+  box_.rows_y = box_.rows_filled = box_.band_y = box_.band_height = box_.out_y = 0;
+  for (uint32_t x = 0; x <= fit_width; x++) box_.x_start[x] = x * src_width / fit_width;
+  params->format = IMAGE_PIXEL_RGB565_LE;
+  params->draw = box_filter_callback;
+  ESP_LOGI(TAG, "[MEME] image %dx%d shown at %dx%d (1/%d + box filter)", width, height,
+           jpg_width_, jpg_height_, 1 << params->scale_shift);
+  return true;
+#else
+  ESP_LOGE(TAG, "[MEME] image %dx%d is too large even at 1/8", width, height);
+  return false;
+#endif
 }
 
-bool ReadJpgBufferInternal(uint32_t file_size, uint16_t* image_buffer, bool flag_raw) {
+// decode the image that was just opened in decoder into image_buffer, closes the decoder.
+// file_data is the whole file if it was opened from memory, NULL for streams.
+static bool DecodeOpenedJpg(const ImageDecoder* decoder, uint16_t* image_buffer,
+                            const uint8_t* file_data, uint32_t file_size) {
+  bool ret = true;
   jpg_image_buffer_read_tmp_ = image_buffer;
-  bool ret = jpeg_decoder_.openRAM(jpg_file_buffer_, file_size, jpg_to_memory_callback);
-  if (ret) {
-    jpg_width_ = jpeg_decoder_.getWidth();
-    jpg_height_ = jpeg_decoder_.getHeight();
+  uint16_t width = decoder->width(), height = decoder->height();
+  jpg_width_ = width;
+  jpg_height_ = height;
 
-    jpeg_decoder_.setMaxOutputSize(MAXOUTPUTSIZE);
-    // RGB565_LITTLE_ENDIAN ； RGB565_BIG_ENDIAN; RGB8888
-    jpeg_decoder_.setPixelType(RGB565_BIG_ENDIAN);
+  bool transposed = ImageOrientationTransposed(orientation_);
+
+  ImageDecodeParams params = {};
+  params.format = IMAGE_PIXEL_RGB565_BE;
+  params.draw = jpg_to_memory_callback;
+  if ((width > screen_width_ || height > screen_height_) &&
+      !KeepFullSize(transposed ? height : width, transposed ? width : height)) {
+    ret = PlanScaledDecode(width, height, &params);
+  }
+  bool box_filter = params.draw == box_filter_callback;
+  bool upright = orientation_ == IMAGE_ORIENTATION_UPRIGHT;
+  frame_mapping_ = OrientFrame(orientation_, jpg_width_, jpg_height_);
 
-    // need to use JPEG_USES_DMA, other wise the image will have glitch
-    if (!jpeg_decoder_.decode(0, 0, JPEG_USES_DMA)) {
-      ret = false;
+  direct_to_panel_ = ret && !box_filter && upright && direct_to_panel_requested_ &&
+                     jpg_width_ == EXAMPLE_LCD_H_RES && jpg_height_ == EXAMPLE_LCD_V_RES &&
+                     DisplayBeginDirectDraw();
+
+  if (ret && jpg_width_ * jpg_height_ > JPG_IMAGE_BUFFER_SIZE) {
+    ESP_LOGE(TAG, "[MEME] image %dx%d does not fit the frame buffer", jpg_width_, jpg_height_);
+    ret = false;
+  }
+  // the panel strips have to be contiguous, which a decode into the frame does not guarantee.
+  // rotated blocks have to go through the callback.
+  if (!box_filter && !direct_to_panel_ && upright) params.framebuffer = image_buffer;
+  ImageSplitResult split = IMAGE_SPLIT_UNSUPPORTED;
+  int64_t start_us = esp_timer_get_time();
+#if IMAGE_LOADER_PARALLEL_DECODE
+  // the strips cannot go to the panel from both cores
+  if (ret && file_data != NULL && !box_filter && !direct_to_panel_) {
+    split = ImageDecoderDecodeSplit(decoder, file_data, file_size, &params);
+  }
+#endif
+  if (split == IMAGE_SPLIT_UNSUPPORTED) {
+    ret = ret && ImageDecoderDecode(decoder, &params);
+  } else {
+    ret = split == IMAGE_SPLIT_DECODED;
+  }
+  if (ret) LatencyRecord(LATENCY_STAGE_DECODE, esp_timer_get_time() - start_us);
+  if (box_filter) {
+    if (ret) {
+      // the last band is only complete once the decode is done
+      box_.rows_filled += box_.band_height;
+      BoxFilterEmitRows();
     }
-    jpeg_decoder_.close();
+    heap_caps_free(box_.rows);
+    box_.rows = NULL;
+  }
+  if (direct_to_panel_) {
+    // a failed or aborted decode left a partial image on the panel, and an LVGL flush between
+    // the strips may have painted the old screen over some of them, let LVGL repaint it
+    if (!DisplayEndDirectDraw()) direct_to_panel_ = false;
+    if (!ret) lv_obj_invalidate(lv_scr_act());
   }
+  direct_to_panel_requested_ = false;
+  decoder->close();
   jpg_image_buffer_read_tmp_ = NULL;
+  if (transposed) {
+    // the frame is shown upright
+    uint16_t stored_width = jpg_width_;
+    jpg_width_ = jpg_height_;
+    jpg_height_ = stored_width;
+  }
+  return ret;
+}
+
+#if IMAGE_LOADER_PREVIEW
+// preview_requested_ asks for the next jpg decode to first show a 1/8 scale preview of it in the
+// preview frame, preview_image_id_ is the image being decoded.
+static bool preview_requested_ = false;
+static int32_t preview_image_id_ = -1;
+static uint16_t* preview_small_ = NULL;
+static uint32_t preview_small_width_ = 0, preview_small_height_ = 0;
+// source column of each preview column, in 1/32 pixels
+static uint16_t preview_x_[SCREEN_MAX_SIDE];
+
+static bool preview_callback(void* user, int x, int y, int w, int h, const uint16_t* pixels,
+                             int stride) {
+  if (decode_abort_) return false;
+  for (int j = 0; j < h; j++) {
+    memcpy(preview_small_ + (y + j) * preview_small_width_ + x, pixels + j * stride, w * 2);
+  }
+  return true;
+}
+
+// source position of the center of destination pixel i, in 1/32 pixels
+static inline uint32_t PreviewSourcePos(uint32_t i, uint32_t src_size, uint32_t dst_size) {
+  int32_t pos = (int32_t)(((2 * i + 1) * src_size * 16) / dst_size) - 16;
+  if (pos < 0) return 0;
+  if (pos > (int32_t)(src_size - 1) * 32) return (src_size - 1) * 32;
+  return pos;
+}
+
+// bilinear upsampling of preview_small_ (little endian) to the frame (big endian), dst_width and
+// dst_height are in the orientation the image is stored in
+static void UpsamplePreview(uint16_t* dst, uint32_t dst_width, uint32_t dst_height) {
+  FrameMapping map = OrientFrame(orientation_, dst_width, dst_height);
+  uint32_t src_width = preview_small_width_, src_height = preview_small_height_;
+  for (uint32_t x = 0; x < dst_width; x++) {
+    preview_x_[x] = PreviewSourcePos(x, src_width, dst_width);
+  }
+  for (uint32_t y = 0; y < dst_height; y++) {
+    uint32_t pos = PreviewSourcePos(y, src_height, dst_height);
+    uint32_t y0 = pos >> 5, wy = pos & 31;
+    const uint16_t* row0 = preview_small_ + y0 * src_width;
+    const uint16_t* row1 = wy ? row0 + src_width : row0;
+    uint16_t* out = dst + map.origin + (int32_t)y * map.step_y;
+    for (uint32_t x = 0; x < dst_width; x++) {
+      uint32_t x0 = preview_x_[x] >> 5, wx = preview_x_[x] & 31;
+      uint32_t x1 = wx ? x0 + 1 : x0;
+      uint32_t top = Lerp565(Spread565(row0[x0]), Spread565(row0[x1]), wx);
+      uint32_t bottom = Lerp565(Spread565(row1[x0]), Spread565(row1[x1]), wx);
+      uint32_t v = Lerp565(top, bottom, wy);
+      out[(int32_t)x * map.step_x] = Swap565(Pack565(v));
+    }
+  }
+}
+
+// qoi has no cheap reduced decode, its 1/8 scale still parses every pixel
+static bool WantsPreview(const ImageDecoder* decoder) {
+  return preview_requested_ && decoder != &kQoiDecoder;
+}
+
+static void DecodeOpenedPreview(const ImageDecoder* decoder);
+#endif
+
+uint8_t* GetJpgFileBuffer() { return jpg_file_buffer_; }
+
+// decodes the image file in data, which can be anywhere in the address space
+static bool DecodeMemory(const ImageDecoder* decoder, const uint8_t* data, uint32_t size,
+                         uint16_t* image_buffer) {
+  SetImageOrientation(decoder == &kQoiDecoder ? IMAGE_ORIENTATION_UPRIGHT
+                                              : ImageExifOrientation(data, size));
+#if IMAGE_LOADER_PREVIEW
+  if (WantsPreview(decoder) && decoder->open_memory(data, size)) {
+    DecodeOpenedPreview(decoder);
+  }
+#endif
+  if (!decoder->open_memory(data, size)) return false;
+  return DecodeOpenedJpg(decoder, image_buffer, data, size);
+}
+
+bool ReadJpgBufferInternal(const ImageDecoder* decoder, uint32_t file_size,
+                           uint16_t* image_buffer) {
+  return DecodeMemory(decoder, jpg_file_buffer_, file_size, image_buffer);
+}
+
+// stream callbacks, so the decoder pulls the data from FatFs while decoding instead of needing
+// the whole file in jpg_file_buffer_ first.
+static int32_t jpg_file_read_callback(void* handle, uint8_t* buffer, int32_t length) {
+  return fread(buffer, 1, length, (FILE*)handle);
+}
+
+static bool jpg_file_seek_callback(void* handle, int32_t position) {
+  return fseek((FILE*)handle, position, SEEK_SET) == 0;
+}
+
+// decodes the image behind a stream positioned anywhere, the caller closes the stream
+static bool DecodeStream(const ImageDecoder* decoder, void* handle, uint32_t size,
+                         ImageReadCallback read, ImageSeekCallback seek, uint16_t* image_buffer) {
+  // reads the markers up to the start of frame, a few hundred bytes for most photos
+  if (!seek(handle, 0)) return false;
+  SetImageOrientation(decoder == &kQoiDecoder ? IMAGE_ORIENTATION_UPRIGHT
+                                              : ImageExifOrientationStream(handle, read, seek));
+  if (!seek(handle, 0)) {
+    ESP_LOGE(TAG, "[SD ERROR] Failed to seek 0 in file");
+    return false;
+  }
+#if IMAGE_LOADER_PREVIEW
+  if (WantsPreview(decoder) && decoder->open_stream(handle, size, read, seek)) {
+    DecodeOpenedPreview(decoder);
+    seek(handle, 0);
+  }
+#endif
+  return decoder->open_stream(handle, size, read, seek) &&
+         DecodeOpenedJpg(decoder, image_buffer, NULL, 0);
+}
+
+static bool ReadJpgFileStreaming(const ImageDecoder* decoder, uint16_t* image_buffer) {
+  if (fp_timebg_ == NULL) return false;
+  FILE* fp = fp_timebg_;
+  fp_timebg_ = NULL;
+
+  fseek(fp, 0, SEEK_END);
+  long filesize = ftell(fp);
+  bool ret = DecodeStream(decoder, fp, filesize, jpg_file_read_callback, jpg_file_seek_callback,
+                          image_buffer);
+  fclose(fp);
+  return ret;
+}
+
+#if IMAGE_LOADER_PHOTO_STORE
+// photo index of the flash store, decoded straight from the mapped flash
+static bool LoadStoreImage(uint32_t index, uint16_t* image_buffer) {
+  const PhotoPackEntry* entry = PhotoStoreGetEntry(index);
+  if (entry == NULL) return false;
+  int64_t start_us = esp_timer_get_time();
+  uint32_t length;
+  const uint8_t* data = PhotoStoreMap(index, &length);
+  if (data == NULL) return false;
+  LatencyRecord(LATENCY_STAGE_READ, esp_timer_get_time() - start_us);
+  bool ret = DecodeMemory(PhotoPackEntryDecoder(entry), data, length, image_buffer);
+  PhotoStoreUnmap();
   return ret;
 }
+#endif
+
+#if IMAGE_LOADER_PHOTO_PACK
+// photo index of the open pack: one positioned read into the jpg file buffer, photos larger
+// than that are streamed from the pack
+static bool LoadPackImage(uint32_t index, uint16_t* image_buffer) {
+  const PhotoPackEntry* entry = PhotoPackGetEntry(index);
+  if (entry == NULL) return false;
+  const ImageDecoder* decoder = PhotoPackEntryDecoder(entry);
+  if (jpg_file_buffer_ != NULL && entry->length <= JPG_FILE_BUFFER_SIZE) {
+    int64_t start_us = esp_timer_get_time();
+    uint32_t file_size = PhotoPackRead(index, jpg_file_buffer_, JPG_FILE_BUFFER_SIZE);
+    if (file_size == 0) return false;
+    LatencyRecord(LATENCY_STAGE_READ, esp_timer_get_time() - start_us);
+    return ReadJpgBufferInternal(decoder, file_size, image_buffer);
+  }
+  PhotoPackStream stream;
+  return PhotoPackOpenStream(index, &stream) &&
+         DecodeStream(decoder, &stream, stream.length, PhotoPackStreamRead, PhotoPackStreamSeek,
+                      image_buffer);
+}
+#endif
 
 bool LoadImageJPG(char* image_path, uint16_t* jpg_image_buffer) {
   if (!OpenJpgImage(image_path)) {
     ESP_LOGE(TAG, "[MEME] Failed to open image file for %s", image_path);
     return false;
   }
+  // read once, a decoder switch takes effect from the next image
+  const ImageDecoder* decoder = ImageDecoderForPath(image_path);
+#if IMAGE_LOADER_PARALLEL_DECODE
+  // splitting at restart markers needs the whole jpg in memory, the header tells if it has them.
+  // all other files keep the streaming decode.
+  long file_size = decoder == &kJpegdecDecoder && jpg_file_buffer_ != NULL ? JpgFileSize() : -1;
+  if (file_size > 0 && file_size <= JPG_FILE_BUFFER_SIZE && fseek(fp_timebg_, 0, SEEK_SET) == 0 &&
+      JpegdecMaySplit(fp_timebg_, jpg_file_read_callback, jpg_file_seek_callback)) {
+    size_t file_length = ReadTimeBGFrameToBuffer(jpg_file_buffer_);
+    return file_length > 0 && ReadJpgBufferInternal(decoder, file_length, jpg_image_buffer);
+  }
+#endif
+#if IMAGE_LOADER_STREAM_DECODE
+  return ReadJpgFileStreaming(decoder, jpg_image_buffer);
+#else
   // load the jpg image
   size_t file_length = ReadTimeBGFrameToBuffer(jpg_file_buffer_);
   if (file_length == 0) {
     return false;
   }
-  return ReadJpgBufferInternal(file_length, jpg_image_buffer, true);
+  return ReadJpgBufferInternal(decoder, file_length, jpg_image_buffer);
+#endif
 }
 
-bool LoadScreenSizeImageJPG(char* image_path) {
-  return LoadImageJPG(image_path, jpg_image_buffer_);
+static uint16_t image_count_;
+static char image_paths_[MAX_NUM_IMAGE][META_FILE_MAX_WIDTH];
+
+// the images are files of their own listed in meta.txt, not in the flash store or a pack
+static bool LooseImages() { return PhotoStoreCount() == 0 && PhotoPackCount() == 0; }
+
+// ring of decoded frames: one FRONT frame that LVGL displays, the others are filled by the
+// loader with the next IMAGE_PREFETCH_DEPTH images of the playlist, so a slide change that hits
+// the ring only swaps a pointer. the loader never writes into the FRONT frame.
+// the preview frame (IMAGE_LOADER_PREVIEW) sits after the ring: it can become FRONT like the
+// others, but the ring lookups below never see it, so a shown preview does not count as having
+// the image and the full decode still runs.
+typedef enum {
+  JPG_FRAME_FREE = 0,
+  JPG_FRAME_DECODING,
+  JPG_FRAME_READY,
+  JPG_FRAME_FRONT,
+  JPG_FRAME_FAILED,  // holds no pixels, keeps the loader from retrying a broken file
+} JpgFrameState;
+
+typedef struct {
+  uint16_t* pixels;
+  uint16_t width;
+  uint16_t height;
+  int32_t image_id;
+  JpgFrameState state;
+  bool on_panel;  // the pixels were already pushed to the panel while decoding
+  bool held;      // the last front, a slide transition may still be reading it
+  uint32_t* tile_hashes;  // FRAME_TILE_COUNT, IMAGE_LOADER_DIRTY_TILES
+  bool hashed;            // tile_hashes are those of the pixels (full screen frames only)
+} JpgFrame;
+
+static JpgFrame jpg_frames_[JPG_FRAME_BUFFER_COUNT + IMAGE_LOADER_PREVIEW];
+
+// called by the loader on a frame it just filled, before the frame is READY
+static void HashFrameTiles(JpgFrame* frame, uint16_t width, uint16_t height) {
+#if IMAGE_LOADER_DIRTY_TILES
+  frame->hashed = frame->tile_hashes != NULL && width == EXAMPLE_LCD_H_RES &&
+                  height == EXAMPLE_LCD_V_RES;
+  if (frame->hashed) FrameTilesHash(frame->pixels, frame->tile_hashes);
+#endif
 }
+static int front_frame_ = -1;
+static int outgoing_frame_ = -1;
 
-int MemeImageWidth() { return jpg_width_; }
+// playlist order over the images (image_paths_ or the photo pack), the image to show is
+// playlist_[target_pos_]. frames_mux_ protects the frame states, the playlist and target_pos_.
+static uint16_t* playlist_ = NULL;
+static int32_t target_pos_ = 0;
+static SemaphoreHandle_t frames_mux_ = NULL;
+static SemaphoreHandle_t loader_wakeup_ = NULL;
+// the loader task gives loader_parked_ when it sees loader_pauses_ and then waits it out. pauses
+// nest (a clip, a benchmark and a store sync can overlap), pause_mux_ serializes the callers.
+static volatile uint8_t loader_pauses_ = 0;
+static SemaphoreHandle_t loader_parked_ = NULL;
+static SemaphoreHandle_t pause_mux_ = NULL;
+static ImagePrefetchStats prefetch_stats_;
+
+static void LockFrames() {
+  if (frames_mux_) xSemaphoreTake(frames_mux_, portMAX_DELAY);
+}
+static void UnlockFrames() {
+  if (frames_mux_) xSemaphoreGive(frames_mux_);
+}
+static void WakeImageLoader() {
+  if (loader_wakeup_) xSemaphoreGive(loader_wakeup_);
+}
 
-int MemeImageHeight() { return jpg_height_; }
+static int32_t PlaylistImageId(int32_t pos) {
+  pos %= image_count_;
+  if (pos < 0) pos += image_count_;
+  return playlist_[pos];
+}
 
-const uint8_t* MemeGetImageBuffer() { return (const uint8_t*)jpg_image_buffer_; }
+static int FindFrame(int32_t image_id, JpgFrameState state) {
+  for (int i = 0; i < JPG_FRAME_BUFFER_COUNT; i++) {
+    if (jpg_frames_[i].state == state && jpg_frames_[i].image_id == image_id) return i;
+  }
+  return -1;
+}
 
-static uint16_t image_count_;
-static char image_paths_[MAX_NUM_IMAGE][META_FILE_MAX_WIDTH];
+static bool HasFrame(int32_t image_id) {
+  return FindFrame(image_id, JPG_FRAME_READY) >= 0 || FindFrame(image_id, JPG_FRAME_FRONT) >= 0 ||
+         FindFrame(image_id, JPG_FRAME_DECODING) >= 0 ||
+         FindFrame(image_id, JPG_FRAME_FAILED) >= 0;
+}
+
+// the prefetch window is the target image (if it is not shown yet) and the images after it.
+static int32_t PrefetchWindowStart() {
+  bool target_shown = front_frame_ >= 0 && front_frame_ != JPG_PREVIEW_FRAME &&
+                      jpg_frames_[front_frame_].image_id == PlaylistImageId(target_pos_);
+  return target_shown ? target_pos_ + 1 : target_pos_;
+}
+
+static bool IsWantedImage(int32_t image_id) {
+  int32_t start = PrefetchWindowStart();
+  for (int k = 0; k < IMAGE_PREFETCH_DEPTH; k++) {
+    if (PlaylistImageId(start + k) == image_id) return true;
+  }
+  return false;
+}
+
+// pick the next image to decode and the frame to decode it into, returns false if the
+// window is already fully decoded. must hold frames_mux_.
+static bool PickPrefetchJob(int32_t* image_id, int* frame_idx) {
+  int32_t start = PrefetchWindowStart();
+  for (int k = 0; k < IMAGE_PREFETCH_DEPTH; k++) {
+    int32_t id = PlaylistImageId(start + k);
+    if (HasFrame(id)) continue;
+    for (int i = 0; i < JPG_FRAME_BUFFER_COUNT; i++) {
+      JpgFrame* frame = &jpg_frames_[i];
+      if (!frame->pixels || frame->held) continue;
+      bool evictable = (frame->state == JPG_FRAME_READY || frame->state == JPG_FRAME_FAILED) &&
+                       !IsWantedImage(frame->image_id);
+      if (frame->state == JPG_FRAME_FREE || evictable) {
+        *image_id = id;
+        *frame_idx = i;
+        return true;
+      }
+    }
+    return false;
+  }
+  return false;
+}
+
+#if IMAGE_LOADER_PREVIEW
+// decodes the image that was just opened in decoder at 1/8 scale (DC only for JPEG), upsamples
+// it into the preview frame and hands that over to MemeSwapImageBuffers(). closes the decoder.
+static void DecodeOpenedPreview(const ImageDecoder* decoder) {
+  preview_requested_ = false;
+  JpgFrame* frame = &jpg_frames_[JPG_PREVIEW_FRAME];
+  uint16_t width = decoder->width(), height = decoder->height();
+  uint32_t out_width = width, out_height = height;
+  if (width > screen_width_ || height > screen_height_) {
+    FitScreen(width, height, &out_width, &out_height);
+  }
+  preview_small_width_ = (width + 7) >> 3;
+  preview_small_height_ = (height + 7) >> 3;
+
+  int64_t start_us = esp_timer_get_time();
+  LockFrames();
+  // a preview still on screen cannot be overwritten, this image goes without one
+  bool ret = frame->pixels != NULL && frame->state != JPG_FRAME_FRONT && !frame->held;
+  if (ret) {
+    frame->state = JPG_FRAME_DECODING;
+    frame->image_id = preview_image_id_;
+  }
+  UnlockFrames();
+  if (ret) {
+    preview_small_ = (uint16_t*)heap_caps_malloc(preview_small_width_ * preview_small_height_ * 2,
+                                                 MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    ret = preview_small_ != NULL;
+  }
+  if (ret) {
+    ImageDecodeParams params = {};
+    params.scale_shift = 3;
+    params.format = IMAGE_PIXEL_RGB565_LE;
+    params.draw = preview_callback;
+    ret = ImageDecoderDecode(decoder, &params);
+  }
+  // upright after UpsamplePreview
+  bool transposed = ImageOrientationTransposed(orientation_);
+  uint16_t shown_width = transposed ? out_height : out_width;
+  uint16_t shown_height = transposed ? out_width : out_height;
+  if (ret) {
+    UpsamplePreview(frame->pixels, out_width, out_height);
+    HashFrameTiles(frame, shown_width, shown_height);
+  }
+  heap_caps_free(preview_small_);
+  preview_small_ = NULL;
+  decoder->close();
+
+  LockFrames();
+  if (frame->state == JPG_FRAME_DECODING) {
+    frame->width = shown_width;
+    frame->height = shown_height;
+    frame->on_panel = false;
+    frame->state = ret && !decode_abort_ ? JPG_FRAME_READY : JPG_FRAME_FREE;
+    if (frame->state == JPG_FRAME_FREE) frame->image_id = -1;
+  }
+  UnlockFrames();
+  if (ret) {
+    ESP_LOGD(TAG, "[MEME] preview of image %d in %d ms", (int)preview_image_id_,
+             (int)((esp_timer_get_time() - start_us) / 1000));
+  }
+}
+#endif
+
+// load a frame from the PSRAM frame cache or its pre-decoded sidecar if possible, otherwise
+// decode the jpg. sets jpg_width_ and jpg_height_, *decoded tells if the sidecar should be
+// (re)written, *cached if the frame came from the frame cache.
+static bool LoadImageFrame(int32_t image_id, char* image_path, uint16_t* pixels, bool* decoded,
+                           bool* cached) {
+  *decoded = false;
+  *cached = false;
+#if IMAGE_FRAME_CACHE
+  if (FrameCacheLookup(image_id, pixels, JPG_IMAGE_BUFFER_SIZE, &jpg_width_, &jpg_height_)) {
+    direct_to_panel_ = false;
+    *cached = true;
+    return true;
+  }
+#endif
+#if IMAGE_LOADER_PHOTO_STORE
+  if (PhotoStoreCount() > 0) return LoadStoreImage(image_id, pixels);
+#endif
+#if IMAGE_LOADER_PHOTO_PACK
+  // no sidecars for pack photos, a sidecar would be a file open again
+  if (PhotoPackCount() > 0) return LoadPackImage(image_id, pixels);
+#endif
+#if IMAGE_SIDECAR_CACHE
+  if (SidecarLoadFrame(image_path, pixels, JPG_IMAGE_BUFFER_SIZE, &jpg_width_, &jpg_height_)) {
+    direct_to_panel_ = false;
+    return true;
+  }
+#endif
+  *decoded = LoadImageJPG(image_path, pixels);
+  return *decoded;
+}
+
+static bool DecodeImageToFrame(int32_t image_id, int frame_idx) {
+  // pack photos have no file of their own
+  static char tmp_file_path[257];
+  tmp_file_path[0] = '\0';
+  if (LooseImages()) snprintf(tmp_file_path, 257, "/sd/prod/%s", image_paths_[image_id]);
+  // ESP_LOGI(TAG, "load image %s", tmp_file_path);
+
+  JpgFrame* frame = &jpg_frames_[frame_idx];
+  bool decoded, cached;
+  bool ret = LoadImageFrame(image_id, tmp_file_path, frame->pixels, &decoded, &cached);
+  if (ret) HashFrameTiles(frame, jpg_width_, jpg_height_);
+  direct_to_panel_requested_ = false;
+#if IMAGE_LOADER_PREVIEW
+  preview_requested_ = false;
+#endif
+
+  bool log_stats = false;
+  LockFrames();
+  frame->on_panel = false;
+  if (ret) {
+    frame->width = jpg_width_;
+    frame->height = jpg_height_;
+    frame->state = JPG_FRAME_READY;
+    // only good until the frame is swapped in, later redraws of it go through LVGL
+    frame->on_panel = direct_to_panel_;
+    prefetch_stats_.decoded++;
+    log_stats = IMAGE_LOADER_STATS_LOG_INTERVAL > 0 && !cached &&
+                prefetch_stats_.decoded % IMAGE_LOADER_STATS_LOG_INTERVAL == 0;
+  } else if (decode_abort_) {
+    frame->state = JPG_FRAME_FREE;
+    frame->image_id = -1;
+  } else {
+    frame->state = JPG_FRAME_FAILED;
+  }
+  UnlockFrames();
+
+#if IMAGE_SIDECAR_CACHE
+  // written after the frame is READY so the SD write does not delay showing it, only this task
+  // ever reuses the frame so the pixels stay valid meanwhile
+  if (decoded) SidecarStoreFrame(tmp_file_path, frame->pixels, frame->width, frame->height);
+#endif
+#if IMAGE_FRAME_CACHE
+  if (ret && !cached) FrameCacheInsert(image_id, frame->pixels, frame->width, frame->height);
+#endif
+  if (log_stats) {
+    LogImagePrefetchStats();
+    LogImageDecoderStats();
+    LogFrameCacheStats();
+    LogLatencyStats();
+  }
+  return ret;
+}
+
+// decode one entry of the prefetch window, returns false when there was nothing to do.
+static bool RunPrefetchJob() {
+  int32_t image_id;
+  int frame_idx;
+  LockFrames();
+  bool has_job = image_count_ > 0 && loader_pauses_ == 0 && PickPrefetchJob(&image_id, &frame_idx);
+  if (has_job) {
+    jpg_frames_[frame_idx].state = JPG_FRAME_DECODING;
+    jpg_frames_[frame_idx].image_id = image_id;
+    decode_abort_ = false;
+    // somebody is waiting for this very image, show it while it decodes
+    direct_to_panel_requested_ =
+        IMAGE_LOADER_DIRECT_TO_PANEL && image_id == PlaylistImageId(target_pos_);
+#if IMAGE_LOADER_PREVIEW
+    preview_requested_ = image_id == PlaylistImageId(target_pos_);
+    preview_image_id_ = image_id;
+#endif
+  }
+  UnlockFrames();
+  if (!has_job) return false;
+
+  if (!DecodeImageToFrame(image_id, frame_idx) && !decode_abort_) {
+    ESP_LOGE(TAG, "[MEME] Failed to load image %d", (int)image_id);
+  }
+  return true;
+}
+
+bool MemeSwapImageBuffers() {
+  if (image_count_ == 0) return false;
+  LockFrames();
+  if (FindFrame(PlaylistImageId(target_pos_), JPG_FRAME_FAILED) >= 0) {
+    // skip images that cannot be decoded, the old photo stays on screen meanwhile
+    target_pos_ = (target_pos_ + 1) % image_count_;
+    WakeImageLoader();
+  }
+  int ready = FindFrame(PlaylistImageId(target_pos_), JPG_FRAME_READY);
+#if IMAGE_LOADER_PREVIEW
+  // the preview is only shown until the full frame is there
+  JpgFrame* preview = &jpg_frames_[JPG_PREVIEW_FRAME];
+  if (ready < 0 && front_frame_ != JPG_PREVIEW_FRAME && preview->state == JPG_FRAME_READY &&
+      preview->image_id == PlaylistImageId(target_pos_)) {
+    ready = JPG_PREVIEW_FRAME;
+  }
+#endif
+  if (ready >= 0) {
+    // the old front stays in the ring as a READY frame until the loader needs it again, an old
+    // preview is just dropped. either way its pixels are held until the LVGL side is done with
+    // them, see MemeGetOutgoingBuffer()
+    if (outgoing_frame_ >= 0) jpg_frames_[outgoing_frame_].held = false;
+    outgoing_frame_ = front_frame_;
+    if (front_frame_ >= 0) {
+      jpg_frames_[front_frame_].state =
+          front_frame_ == JPG_PREVIEW_FRAME ? JPG_FRAME_FREE : JPG_FRAME_READY;
+      jpg_frames_[front_frame_].on_panel = false;
+      jpg_frames_[front_frame_].held = true;
+    }
+    jpg_frames_[ready].state = JPG_FRAME_FRONT;
+    front_frame_ = ready;
+  }
+  UnlockFrames();
+  return ready >= 0;
+}
+
+bool MemeImageOnPanel() { return front_frame_ >= 0 && jpg_frames_[front_frame_].on_panel; }
+
+int MemeImageWidth() { return front_frame_ >= 0 ? jpg_frames_[front_frame_].width : 0; }
+
+int MemeImageHeight() { return front_frame_ >= 0 ? jpg_frames_[front_frame_].height : 0; }
+
+const uint8_t* MemeGetImageBuffer() {
+  return front_frame_ >= 0 ? (const uint8_t*)jpg_frames_[front_frame_].pixels : NULL;
+}
+
+const uint32_t* MemeGetImageTileHashes() {
+  if (front_frame_ < 0 || !jpg_frames_[front_frame_].hashed) return NULL;
+  return jpg_frames_[front_frame_].tile_hashes;
+}
+
+const uint16_t* MemeGetOutgoingBuffer() {
+  if (outgoing_frame_ < 0 || front_frame_ < 0) return NULL;
+  const JpgFrame* outgoing = &jpg_frames_[outgoing_frame_];
+  const JpgFrame* front = &jpg_frames_[front_frame_];
+  // nothing to transition from when the full decode replaces the preview of the same image or
+  // the new photo is already on the panel
+  if (outgoing->image_id == front->image_id || front->on_panel) return NULL;
+  bool full_screen = outgoing->width == EXAMPLE_LCD_H_RES &&
+                     outgoing->height == EXAMPLE_LCD_V_RES && front->width == EXAMPLE_LCD_H_RES &&
+                     front->height == EXAMPLE_LCD_V_RES;
+  return full_screen ? outgoing->pixels : NULL;
+}
+
+void MemeReleaseOutgoingBuffer() {
+  LockFrames();
+  if (outgoing_frame_ >= 0) jpg_frames_[outgoing_frame_].held = false;
+  outgoing_frame_ = -1;
+  UnlockFrames();
+  // the loader may have been waiting for a frame to decode into
+  WakeImageLoader();
+}
+
+void GetImagePrefetchStats(ImagePrefetchStats* stats) {
+  LockFrames();
+  *stats = prefetch_stats_;
+  UnlockFrames();
+}
+
+void LogImagePrefetchStats() {
+  ImagePrefetchStats stats;
+  GetImagePrefetchStats(&stats);
+  uint32_t changes = stats.hits + stats.misses;
+  ESP_LOGI(TAG, "prefetch hit rate %lu%% (%lu/%lu), %lu decoded, %lu invalidated%s",
+           (unsigned long)(changes ? (uint64_t)stats.hits * 100 / changes : 0),
+           (unsigned long)stats.hits, (unsigned long)changes, (unsigned long)stats.decoded,
+           (unsigned long)stats.invalidations, stats.shuffled ? ", shuffled" : "");
+}
 
 void InitializeImageLoader() {
   ESP_LOGI(TAG, "Initialize image loader.");
-  current_image_id_ = ParameterGetCurrentTab();
 
   // allocate memory for buffers
+#if !IMAGE_LOADER_STREAM_DECODE || IMAGE_LOADER_PARALLEL_DECODE
   jpg_file_buffer_ =
       (uint8_t*)heap_caps_malloc(JPG_FILE_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
   if (!jpg_file_buffer_) {
     ESP_LOGE(TAG, "[MEME] Failed to load allocate jpg file buffer!!!");
   }
+#endif
+
+#if IMAGE_LOADER_DIRECT_TO_PANEL
+  DisplayReserveDirectDraw();
+#endif
 
-  jpg_image_buffer_ =
-      (uint16_t*)heap_caps_malloc(JPG_IMAGE_BUFFER_SIZE * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-  if (!jpg_image_buffer_) {
-    ESP_LOGE(TAG, "[MEME] Failed to load allocate jpg image data buffer!!!");
+  for (int i = 0; i < JPG_FRAME_BUFFER_COUNT + IMAGE_LOADER_PREVIEW; i++) {
+    jpg_frames_[i].pixels = (uint16_t*)heap_caps_malloc(JPG_IMAGE_BUFFER_SIZE * 2,
+                                                        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!jpg_frames_[i].pixels) {
+      ESP_LOGE(TAG, "[MEME] Failed to load allocate jpg image data buffer %d!!!", i);
+    }
+#if IMAGE_LOADER_DIRTY_TILES
+    // no hashes only means the frame is always redrawn whole
+    jpg_frames_[i].tile_hashes = (uint32_t*)heap_caps_malloc(
+        FRAME_TILE_COUNT * sizeof(uint32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+    jpg_frames_[i].image_id = -1;
+    jpg_frames_[i].state = JPG_FRAME_FREE;
   }
 
+  image_count_ = 0;
+#if IMAGE_LOADER_PHOTO_STORE
+  // photos synced into flash need no SD card at all
+  if (InitializePhotoStore()) image_count_ = PhotoStoreCount();
+#endif
+#if IMAGE_LOADER_PHOTO_PACK
+  // a photo pack replaces meta.txt and the loose files
+  if (image_count_ == 0 && PhotoPackOpen(PHOTO_PACK_PATH)) image_count_ = PhotoPackCount();
+#endif
   // count stereo memes
-  image_count_ = ReadMetaFileLines("/sd/prod/meta.txt", image_paths_, MAX_NUM_IMAGE);
+  if (image_count_ == 0) {
+    image_count_ = ReadMetaFileLines("/sd/prod/meta.txt", image_paths_, MAX_NUM_IMAGE);
+  }
+  playlist_ = (uint16_t*)heap_caps_malloc((image_count_ + 1) * sizeof(uint16_t),
+                                          MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!playlist_) {
+    ESP_LOGE(TAG, "[MEME] Failed to allocate the playlist!!!");
+    image_count_ = 0;
+  }
   ESP_LOGI(TAG, "[MEME] load %d images\n", image_count_);
+#if IMAGE_SIDECAR_CACHE
+  InitializeImageSidecar();
+#endif
+#if IMAGE_FRAME_CACHE
+  InitializeFrameCache();
+#endif
+  InitializeImageDecoder();
+
+  for (uint16_t i = 0; i < image_count_; i++) playlist_[i] = i;
+  // resume from the last shown image, the first LoadNextImageJPG() steps to the one after it
+  target_pos_ = ParameterGetCurrentTab();
+  frames_mux_ = xSemaphoreCreateMutex();
 }
 
 uint16_t ReadMetaFileLines(const char* file_path, char meta_lines[][META_FILE_MAX_WIDTH],
@@ -161,19 +1065,194 @@ uint16_t ReadMetaFileLines(const char* file_path, char meta_lines[][META_FILE_MA
 
 bool LoadNextImageJPG() {
   if (image_count_ == 0) return false;
-  // uint16_t image_id = current_image_id_;
-  // while (image_id == current_image_id_) {
-  //   image_id = esp_random() % image_count_;
-  // }
-  // current_image_id_ = image_id;
+  LockFrames();
+  target_pos_ = (target_pos_ + 1) % image_count_;
+  int32_t image_id;
+  int frame_idx;
+  bool has_job = PickPrefetchJob(&image_id, &frame_idx);
+  if (has_job) {
+    jpg_frames_[frame_idx].state = JPG_FRAME_DECODING;
+    jpg_frames_[frame_idx].image_id = image_id;
+    decode_abort_ = false;
+  }
+  UnlockFrames();
+  // the target is always the first entry of the window, so it is the one picked here
+  return has_job && DecodeImageToFrame(image_id, frame_idx);
+}
+
+// loader task: SD read and decode run here instead of inside lv_timer_handler(). slide changes
+// only move target_pos_ and wake the task, which keeps the prefetch window decoded.
+static int32_t persisted_image_id_ = -1;
+
+// reported by the LVGL tick, the PMU reads are not safe from two tasks
+static volatile bool charging_ = false;
 
-  int32_t image_id = ++current_image_id_ % image_count_;
-  current_image_id_ = image_id;
-  ParameterSetCurrentTab(current_image_id_);
+void SetImageLoaderCharging(bool charging) { charging_ = charging; }
+
+#if IMAGE_SIDECAR_CACHE
+// while charging, idle loader time goes into writing the sidecars of the whole catalog. a slide
+// request aborts the warm decode (warming_ is protected by frames_mux_).
+static uint16_t warm_cursor_ = 0;
+static uint16_t* warm_frame_ = NULL;
+static bool warming_ = false;
+
+// returns false when there is nothing to warm right now
+static bool RunSidecarWarmJob() {
+  if (loader_pauses_ > 0 || warm_cursor_ >= image_count_ || !LooseImages() || !charging_) {
+    return false;
+  }
+  if (warm_frame_ == NULL) {
+    warm_frame_ = (uint16_t*)heap_caps_malloc(JPG_IMAGE_BUFFER_SIZE * 2,
+                                              MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (warm_frame_ == NULL) return false;
+  }
 
   static char tmp_file_path[257];
-  snprintf(tmp_file_path, 257, "/sd/prod/%s", image_paths_[image_id]);
-  // ESP_LOGI(TAG, "load image %s", tmp_file_path);
+  snprintf(tmp_file_path, 257, "/sd/prod/%s", image_paths_[warm_cursor_]);
+  LockFrames();
+  decode_abort_ = false;
+  warming_ = true;
+  UnlockFrames();
+  bool decoded = !SidecarIsValid(tmp_file_path) && LoadImageJPG(tmp_file_path, warm_frame_);
+  LockFrames();
+  warming_ = false;
+  bool aborted = decode_abort_;
+  UnlockFrames();
+  // the slide request goes first, this image is warmed again later
+  if (aborted) return true;
+  if (decoded) SidecarStoreFrame(tmp_file_path, warm_frame_, jpg_width_, jpg_height_);
+  if (++warm_cursor_ == image_count_) {
+    ESP_LOGI(TAG, "[MEME] sidecar cache warmed for %d images", image_count_);
+    heap_caps_free(warm_frame_);
+    warm_frame_ = NULL;
+  }
+  return true;
+}
+#endif
+
+static void image_loader_task(void* arg) {
+  ESP_LOGI(TAG, "Starting image loader task");
+  while (1) {
+    if (loader_pauses_ > 0) {
+      xSemaphoreGive(loader_parked_);
+      while (loader_pauses_ > 0) xSemaphoreTake(loader_wakeup_, portMAX_DELAY);
+      continue;
+    }
+    // keep the shown image in NVS so we resume from it after a reboot
+    int32_t shown_id = front_frame_ >= 0 ? jpg_frames_[front_frame_].image_id : -1;
+    if (shown_id >= 0 && shown_id != persisted_image_id_) {
+      ParameterSetCurrentTab(shown_id);
+      persisted_image_id_ = shown_id;
+    }
+    if (RunPrefetchJob()) continue;
+#if IMAGE_SIDECAR_CACHE
+    if (RunSidecarWarmJob()) continue;
+    // poll the charger now and then, a slide change wakes us up earlier
+    xSemaphoreTake(loader_wakeup_, pdMS_TO_TICKS(IMAGE_SIDECAR_WARM_POLL_MS));
+#else
+    xSemaphoreTake(loader_wakeup_, portMAX_DELAY);
+#endif
+  }
+}
+
+void StartImageLoaderTask() {
+  loader_wakeup_ = xSemaphoreCreateBinary();
+  loader_parked_ = xSemaphoreCreateBinary();
+  pause_mux_ = xSemaphoreCreateMutex();
+  assert(loader_wakeup_ && loader_parked_ && pause_mux_ && frames_mux_);
+  xTaskCreatePinnedToCore(image_loader_task, "ImageLoader", IMAGE_LOADER_TASK_STACK_SIZE, NULL,
+                          IMAGE_LOADER_TASK_PRIORITY, NULL, IMAGE_LOADER_TASK_CORE);
+}
+
+bool RequestLoadImage(int32_t image_id) {
+  if (image_count_ == 0) return false;
+  LockFrames();
+  if (image_id == IMAGE_LOAD_NEXT) {
+    target_pos_ = (target_pos_ + 1) % image_count_;
+  } else {
+    // jump: find the playlist position of the image, the window moves with it
+    for (int32_t pos = 0; pos < image_count_; pos++) {
+      if (playlist_[pos] == image_id % image_count_) {
+        target_pos_ = pos;
+        break;
+      }
+    }
+  }
+  int32_t target_id = PlaylistImageId(target_pos_);
+#if IMAGE_SIDECAR_CACHE
+  // the window moved, so the prefetch has work again
+  if (warming_) decode_abort_ = true;
+#endif
+  if (FindFrame(target_id, JPG_FRAME_READY) >= 0) {
+    prefetch_stats_.hits++;
+  } else {
+    prefetch_stats_.misses++;
+    // do not let a prefetch of a later image delay the one the user is waiting for
+    for (int i = 0; i < JPG_FRAME_BUFFER_COUNT; i++) {
+      if (jpg_frames_[i].state == JPG_FRAME_DECODING && jpg_frames_[i].image_id != target_id) {
+        decode_abort_ = true;
+      }
+    }
+  }
+  UnlockFrames();
+  WakeImageLoader();
+  return true;
+}
+
+void PauseImageLoader() {
+  if (pause_mux_ == NULL) return;
+  xSemaphoreTake(pause_mux_, portMAX_DELAY);
+  if (loader_pauses_++ == 0) {
+    LockFrames();
+    // the aborted frame is freed and decoded again after the pause
+    decode_abort_ = true;
+    UnlockFrames();
+    WakeImageLoader();
+    xSemaphoreTake(loader_parked_, portMAX_DELAY);
+  }
+  xSemaphoreGive(pause_mux_);
+}
+
+void ResumeImageLoader() {
+  if (pause_mux_ == NULL) return;
+  xSemaphoreTake(pause_mux_, portMAX_DELAY);
+  if (loader_pauses_ > 0 && --loader_pauses_ == 0) WakeImageLoader();
+  xSemaphoreGive(pause_mux_);
+}
+
+void SetImagePlaylistShuffle(bool shuffle) {
+  if (image_count_ == 0) return;
+  LockFrames();
+  int32_t target_id = PlaylistImageId(target_pos_);
+  for (uint16_t i = 0; i < image_count_; i++) playlist_[i] = i;
+  if (shuffle) {
+    for (uint16_t i = image_count_ - 1; i > 0; i--) {
+      uint16_t j = esp_random() % (i + 1);
+      uint16_t tmp = playlist_[i];
+      playlist_[i] = playlist_[j];
+      playlist_[j] = tmp;
+    }
+  }
+  prefetch_stats_.shuffled = shuffle;
+  for (int32_t pos = 0; pos < image_count_; pos++) {
+    if (playlist_[pos] == target_id) target_pos_ = pos;
+  }
+  // drop prefetched frames that are no longer ahead in the new order
+  for (int i = 0; i < JPG_FRAME_BUFFER_COUNT; i++) {
+    JpgFrame* frame = &jpg_frames_[i];
+    if (frame->state == JPG_FRAME_READY && !IsWantedImage(frame->image_id)) {
+      frame->state = JPG_FRAME_FREE;
+      frame->image_id = -1;
+      prefetch_stats_.invalidations++;
+    }
+  }
+  UnlockFrames();
+  WakeImageLoader();
+}
 
-  return LoadImageJPG(tmp_file_path, jpg_image_buffer_);
+bool PollImageFrameReady() {
+  if (!MemeSwapImageBuffers()) return false;
+  // a frame left the window, let the loader refill it
+  WakeImageLoader();
+  return true;
 }
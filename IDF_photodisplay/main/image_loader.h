@@ -1,11 +1,95 @@
-
+#pragma once
 
 #include "display_sh86001.h"
 #include "esp_random.h"
+#include "image_decoder.h"
 #include "sdmmc_driver.h"
 
 #define META_FILE_MAX_WIDTH 20
 #define MAX_NUM_IMAGE 1000
+// whole jpgs up to this size are read into memory before decoding
+#define JPG_FILE_BUFFER_SIZE 200000
+
+// the loader task runs on the core LVGL is not pinned to (see EXAMPLE_LVGL_TASK_CORE)
+#define IMAGE_LOADER_TASK_STACK_SIZE (8 * 1024)
+#define IMAGE_LOADER_TASK_PRIORITY 3
+#define IMAGE_LOADER_TASK_CORE 1
+#define IMAGE_LOAD_NEXT (-1)
+
+// number of decoded frames (368x448 RGB565, ~330 KB of PSRAM each) the loader keeps ready
+// ahead of the shown one, 2 ~ 6 is reasonable.
+#define IMAGE_PREFETCH_DEPTH 3
+
+// 1: the decoder pulls the file through read/seek callbacks while decoding, no size limit.
+// 0: the whole file is read into a 200 KB staging buffer first and decoded from RAM, which is
+// too small for most .qoi photos.
+#define IMAGE_LOADER_STREAM_DECODE 1
+
+// 1: jpgs up to 200 KB are read into memory and, when they have restart markers (DRI), decoded
+// on both cores at once (see ImageDecoderDecodeSplit). needs IMAGE_DECODER_JPEGDEC, costs a
+// second 17.5 KB decoder instance. other files fall back to the single core decode.
+#define IMAGE_LOADER_PARALLEL_DECODE 1
+
+// images larger than the screen are decoded at 1/2 ~ 1/8 scale. 1: the scale that lands at or
+// just above the size that fits the screen, then box filtered down to that size. 0: the first
+// scale that fits within the screen (faster, but can come out much smaller).
+#define IMAGE_LOADER_BOX_FILTER 1
+
+// 1: when a slide change has to wait for a decode, full screen images are pushed to the panel
+// strip by strip while decoding instead of being composed by LVGL afterwards.
+#define IMAGE_LOADER_DIRECT_TO_PANEL 0
+
+// 1: when a slide change has to wait for a jpg decode, the image is first decoded at 1/8 scale
+// (DC only, a fraction of the full decode), upsampled to full size and shown right away, the
+// full decode replaces it when done. costs one more frame of PSRAM for the preview.
+#define IMAGE_LOADER_PREVIEW 1
+
+// 1: photos larger than the screen up to KEN_BURNS_MAX_WIDTH x KEN_BURNS_MAX_HEIGHT are kept
+// at full size and shown with a slow pan and zoom (see ken_burns.h) instead of being scaled down
+// to fit. every frame buffer grows to that size (~740 KB of PSRAM at 1.5x instead of ~330 KB),
+// only worth it for photo sets cropped with tools/batch_center_crop.py in kenburns mode.
+#define IMAGE_LOADER_KEN_BURNS 0
+#define KEN_BURNS_MAX_WIDTH (EXAMPLE_LCD_H_RES * 3 / 2)
+#define KEN_BURNS_MAX_HEIGHT (EXAMPLE_LCD_V_RES * 3 / 2)
+
+// 1: every full screen frame is hashed in 16x16 tiles when it is loaded (see frame_tiles.h), so
+// a slide change only redraws the tiles that changed. costs ~2.5 KB of PSRAM per frame.
+#define IMAGE_LOADER_DIRTY_TILES 1
+
+// 1: when PHOTO_PACK_PATH is on the SD card, the photos are read from that one pack file (see
+// photo_pack.h) instead of meta.txt and a file per photo. pack photos skip the sidecar cache.
+#define IMAGE_LOADER_PHOTO_PACK 1
+
+// 1: when the "photos" flash partition holds a synced photo pack (see photo_store.h), the photos
+// are decoded straight from the mapped flash and the SD card is not read at all. it is preferred
+// over the pack on the SD card.
+#define IMAGE_LOADER_PHOTO_STORE 1
+
+// 1: keep raw RGB565 copies of decoded photos on the SD card (see image_sidecar.h) and fill
+// them for the whole catalog while the device is charging.
+#define IMAGE_SIDECAR_CACHE 1
+#define IMAGE_SIDECAR_WARM_POLL_MS 5000
+
+// 1: keep recently shown frames in PSRAM (see frame_cache.h), in addition to the prefetch ring
+#define IMAGE_FRAME_CACHE 1
+
+// decoder and frame cache stats are logged every this many decoded frames, 0 disables it
+#define IMAGE_LOADER_STATS_LOG_INTERVAL 50
+
+// pixels of every decoded frame buffer
+#if IMAGE_LOADER_KEN_BURNS
+#define JPG_IMAGE_BUFFER_SIZE (KEN_BURNS_MAX_WIDTH * KEN_BURNS_MAX_HEIGHT)
+#else
+#define JPG_IMAGE_BUFFER_SIZE (EXAMPLE_LCD_H_RES * EXAMPLE_LCD_V_RES)
+#endif
+
+typedef struct {
+  uint32_t hits;           // slide changes served from the prefetch ring
+  uint32_t misses;         // slide changes that had to wait for a decode
+  uint32_t invalidations;  // prefetched frames dropped because the playlist order changed
+  uint32_t decoded;        // frames decoded by the loader
+  bool shuffled;           // the playlist is in random order
+} ImagePrefetchStats;
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,12 +97,48 @@ extern "C" {
 
 void InitializeImageLoader();
 bool LoadImageJPG(char* image_path, uint16_t* jpg_image_buffer);
-bool LoadScreenSizeImageJPG(char* image_path);
+// synchronously decodes the next playlist image into a free frame, which is not visible until
+// MemeSwapImageBuffers() is called (with the LVGL lock held).
 bool LoadNextImageJPG();
+bool MemeSwapImageBuffers();
 
+// asynchronous loading, the SD read and decode run in the loader task, which keeps the next
+// IMAGE_PREFETCH_DEPTH images decoded. RequestLoadImage() takes an image id (jump) or
+// IMAGE_LOAD_NEXT, PollImageFrameReady() is called from the LVGL side (lock held) and returns
+// true when a new frame was swapped to the front.
+void StartImageLoaderTask();
+bool RequestLoadImage(int32_t image_id);
+bool PollImageFrameReady();
+void SetImagePlaylistShuffle(bool shuffle);
+// PauseImageLoader() aborts the decode in progress and returns once the loader task is idle, so
+// somebody else can use the decoder. slide changes meanwhile are only served from ready frames.
+// pauses nest, the loader runs again after as many ResumeImageLoader() calls.
+void PauseImageLoader();
+void ResumeImageLoader();
+void GetImagePrefetchStats(ImagePrefetchStats* stats);
+// the charger state, the sidecar cache is warmed while charging. LVGL side, which reads the PMU.
+void SetImageLoaderCharging(bool charging);
+void LogImagePrefetchStats();
+
+// true if the front frame is already on the panel, so LVGL only needs to redraw the overlays
+bool MemeImageOnPanel();
 int MemeImageWidth();
 int MemeImageHeight();
 const uint8_t* MemeGetImageBuffer();
+// the FRAME_TILE_COUNT tile hashes of the front frame, NULL unless it is a full screen frame
+const uint32_t* MemeGetImageTileHashes();
+// the front frame before the last swap, kept untouched by the loader until
+// MemeReleaseOutgoingBuffer() so a slide transition can read it. NULL unless both the old and the
+// new front are full screen frames of different images. LVGL side, lock held.
+const uint16_t* MemeGetOutgoingBuffer();
+void MemeReleaseOutgoingBuffer();
+
+// decodes the first file_size bytes of the jpg file buffer into image_buffer, which has to hold
+// JPG_IMAGE_BUFFER_SIZE pixels. the file buffer is NULL when IMAGE_LOADER_STREAM_DECODE does
+// not need it.
+uint8_t* GetJpgFileBuffer();
+bool ReadJpgBufferInternal(const ImageDecoder* decoder, uint32_t file_size,
+                           uint16_t* image_buffer);
 
 uint16_t ReadMetaFileLines(const char* file_path, char meta_lines[][META_FILE_MAX_WIDTH],
                            uint16_t max_num_lines);
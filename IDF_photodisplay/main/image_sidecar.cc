@@ -0,0 +1,118 @@
+#include "image_sidecar.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+
+static const char* TAG = "SIDECAR";
+
+// FNV-1a over the jpg path, gives an 8.3 friendly file name
+static void SidecarPath(const char* image_path, char* sidecar_path, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (const char* c = image_path; *c; c++) {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+  snprintf(sidecar_path, size, "%s/%08lX.R56", IMAGE_SIDECAR_DIR, (unsigned long)hash);
+}
+
+static bool FillHeader(const char* image_path, ImageSidecarHeader* header) {
+  struct stat st;
+  if (stat(image_path, &st) != 0) return false;
+  memset(header, 0, sizeof(ImageSidecarHeader));
+  header->magic = IMAGE_SIDECAR_MAGIC;
+  header->version = IMAGE_SIDECAR_VERSION;
+  header->header_size = IMAGE_SIDECAR_HEADER_SIZE;
+  header->src_size = st.st_size;
+  header->src_mtime = st.st_mtime;
+  strncpy(header->src_path, image_path, IMAGE_SIDECAR_PATH_SIZE - 1);
+  return true;
+}
+
+// open the sidecar and check it against the current jpg, returns the file positioned at the
+// pixel data or NULL if it is missing or stale.
+static FILE* OpenValidSidecar(const char* image_path, ImageSidecarHeader* header) {
+  ImageSidecarHeader expected;
+  if (!FillHeader(image_path, &expected)) return NULL;
+
+  char sidecar_path[64];
+  SidecarPath(image_path, sidecar_path, sizeof(sidecar_path));
+  FILE* fp = fopen(sidecar_path, "rb");
+  if (fp == NULL) return NULL;
+
+  if (fread(header, 1, sizeof(ImageSidecarHeader), fp) != sizeof(ImageSidecarHeader) ||
+      header->magic != IMAGE_SIDECAR_MAGIC || header->version != IMAGE_SIDECAR_VERSION ||
+      header->src_size != expected.src_size || header->src_mtime != expected.src_mtime ||
+      strncmp(header->src_path, expected.src_path, IMAGE_SIDECAR_PATH_SIZE) != 0 ||
+      fseek(fp, header->header_size, SEEK_SET) != 0) {
+    fclose(fp);
+    return NULL;
+  }
+  return fp;
+}
+
+void InitializeImageSidecar() {
+  struct stat st;
+  if (stat(IMAGE_SIDECAR_DIR, &st) != 0 && mkdir(IMAGE_SIDECAR_DIR, 0775) != 0) {
+    ESP_LOGE(TAG, "Failed to create %s. Error: %s", IMAGE_SIDECAR_DIR, strerror(errno));
+  }
+}
+
+bool SidecarIsValid(const char* image_path) {
+  ImageSidecarHeader header;
+  FILE* fp = OpenValidSidecar(image_path, &header);
+  if (fp == NULL) return false;
+  fclose(fp);
+  return true;
+}
+
+bool SidecarLoadFrame(const char* image_path, uint16_t* pixels, uint32_t max_pixels,
+                      uint16_t* width, uint16_t* height) {
+  ImageSidecarHeader header;
+  FILE* fp = OpenValidSidecar(image_path, &header);
+  if (fp == NULL) return false;
+
+  size_t num_bytes = (size_t)header.width * header.height * 2;
+  bool ret = (uint32_t)header.width * header.height <= max_pixels;
+  if (ret) {
+    // no stdio buffering, the whole frame is one large read straight into the destination
+    setvbuf(fp, NULL, _IONBF, 0);
+    ret = fread(pixels, 1, num_bytes, fp) == num_bytes;
+  }
+  fclose(fp);
+  if (!ret) {
+    ESP_LOGE(TAG, "[SD ERROR] Failed to read sidecar of %s", image_path);
+    return false;
+  }
+  *width = header.width;
+  *height = header.height;
+  return true;
+}
+
+bool SidecarStoreFrame(const char* image_path, const uint16_t* pixels, uint16_t width,
+                       uint16_t height) {
+  static uint8_t header_block[IMAGE_SIDECAR_HEADER_SIZE];
+  ImageSidecarHeader* header = (ImageSidecarHeader*)header_block;
+  if (!FillHeader(image_path, header)) return false;
+  header->width = width;
+  header->height = height;
+
+  char sidecar_path[64];
+  SidecarPath(image_path, sidecar_path, sizeof(sidecar_path));
+  FILE* fp = fopen(sidecar_path, "wb");
+  if (fp == NULL) {
+    ESP_LOGE(TAG, "Failed to open file %s. Error: %s", sidecar_path, strerror(errno));
+    return false;
+  }
+
+  size_t num_bytes = (size_t)width * height * 2;
+  bool ret = fwrite(header_block, 1, IMAGE_SIDECAR_HEADER_SIZE, fp) == IMAGE_SIDECAR_HEADER_SIZE &&
+             fwrite(pixels, 1, num_bytes, fp) == num_bytes;
+  fclose(fp);
+  if (!ret) {
+    // never leave a truncated sidecar behind, it would pass the header check
+    ESP_LOGE(TAG, "[SD ERROR] Failed to write %s", sidecar_path);
+    remove(sidecar_path);
+  }
+  return ret;
+}
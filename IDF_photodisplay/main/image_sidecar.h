@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// pre-decoded frames: the first decode of /sd/prod/X.jpg stores the raw RGB565_BIG_ENDIAN pixels
+// in IMAGE_SIDECAR_DIR, later displays read them back with a single sequential read.
+// FatFs runs without long file names here, so the sidecar is named after a hash of the path.
+#define IMAGE_SIDECAR_DIR "/sd/prod/R565"
+#define IMAGE_SIDECAR_MAGIC 0x35363552  // "R565"
+#define IMAGE_SIDECAR_VERSION 1
+// the pixels start at a sector boundary, so FatFs can read them straight into the frame
+#define IMAGE_SIDECAR_HEADER_SIZE 512
+#define IMAGE_SIDECAR_PATH_SIZE 64
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint16_t width;
+  uint16_t height;
+  // size and mtime of the source jpg, a mismatch means the sidecar is stale
+  uint32_t src_size;
+  int64_t src_mtime;
+  char src_path[IMAGE_SIDECAR_PATH_SIZE];
+} ImageSidecarHeader;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void InitializeImageSidecar();
+// returns false if there is no valid sidecar, max_pixels is the capacity of pixels
+bool SidecarLoadFrame(const char* image_path, uint16_t* pixels, uint32_t max_pixels,
+                      uint16_t* width, uint16_t* height);
+bool SidecarStoreFrame(const char* image_path, const uint16_t* pixels, uint16_t width,
+                       uint16_t height);
+bool SidecarIsValid(const char* image_path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,162 @@
+#include "ken_burns.h"
+#include "display_sh86001.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "image_loader.h"
+#include "latency_stats.h"
+#include "rgb565.h"
+
+static const char* TAG = "KENBURNS";
+
+// positions along the pan are fixed point, FRACTION_ONE is the end
+#define FRACTION_SHIFT 10
+#define FRACTION_ONE (1 << FRACTION_SHIFT)
+#define KEN_BURNS_FRAME_US (1000000 / KEN_BURNS_FPS)
+
+typedef struct {
+  const uint16_t* pixels;  // big endian RGB565, like the frames
+  uint32_t width, height;
+  // view scale in photo pixels per screen pixel (16.16), and where the view sits within the
+  // room the photo leaves around it at that scale (0 .. FRACTION_ONE), at the start and the end
+  uint32_t scale[2];
+  uint32_t room_x[2], room_y[2];
+  int64_t start_us;
+  bool at_rest;
+} KenBurnsPan;
+
+static volatile bool enabled_ = KEN_BURNS_ENABLED;
+static KenBurnsPan pan_;
+// the view of the current frame, origin in the photo and scale, 16.16
+static uint32_t view_x_, view_y_, view_scale_;
+// photo column and 1/32 weight towards the next one, for every screen column
+static uint16_t column_x_[EXAMPLE_LCD_H_RES];
+static uint8_t column_weight_[EXAMPLE_LCD_H_RES];
+// the two photo rows around a screen row, blended vertically and spread (see Spread565)
+static uint32_t row_spread_[KEN_BURNS_MAX_WIDTH];
+static int64_t last_frame_us_ = 0;
+static KenBurnsStats stats_;
+
+static inline uint32_t Interpolate(uint32_t a, uint32_t b, uint32_t t) {
+  return (uint32_t)(((uint64_t)a * (FRACTION_ONE - t) + (uint64_t)b * t) >> FRACTION_SHIFT);
+}
+
+// smoothstep, slow at both ends
+static uint32_t EaseInOut(uint32_t t) {
+  uint64_t p = t;
+  return (uint32_t)((p * p * (3 * FRACTION_ONE - 2 * p)) >> (2 * FRACTION_SHIFT));
+}
+
+void SetKenBurnsEnabled(bool enabled) {
+  // takes effect from the next photo
+  enabled_ = enabled;
+}
+
+bool KenBurnsEnabled() { return enabled_; }
+
+bool KenBurnsStart(const uint16_t* pixels, int width, int height) {
+  KenBurnsStop();
+  if (!enabled_ || pixels == NULL || width < EXAMPLE_LCD_H_RES || height < EXAMPLE_LCD_V_RES ||
+      width > KEN_BURNS_MAX_WIDTH || height > KEN_BURNS_MAX_HEIGHT ||
+      (width == EXAMPLE_LCD_H_RES && height == EXAMPLE_LCD_V_RES)) {
+    return false;
+  }
+  // the widest view with the screen aspect that fits in the photo, and the closest one
+  uint32_t scale_x = ((uint32_t)width << 16) / EXAMPLE_LCD_H_RES;
+  uint32_t scale_y = ((uint32_t)height << 16) / EXAMPLE_LCD_V_RES;
+  uint32_t wide = scale_x < scale_y ? scale_x : scale_y;
+  uint32_t close = wide * KEN_BURNS_ZOOM_PERCENT / 100;
+  if (close < (1 << 16)) close = 1 << 16;
+
+  bool zoom_in = esp_random() & 1;
+  pan_.scale[0] = zoom_in ? wide : close;
+  pan_.scale[1] = zoom_in ? close : wide;
+  for (int i = 0; i < 2; i++) {
+    pan_.room_x[i] = esp_random() % (FRACTION_ONE + 1);
+    pan_.room_y[i] = esp_random() % (FRACTION_ONE + 1);
+  }
+  pan_.width = width;
+  pan_.height = height;
+  pan_.start_us = esp_timer_get_time();
+  pan_.at_rest = false;
+  pan_.pixels = pixels;
+  stats_.pans++;
+  KenBurnsStep();
+  ESP_LOGD(TAG, "%dx%d, zoom %s", width, height, zoom_in ? "in" : "out");
+  return true;
+}
+
+void KenBurnsStop() {
+  pan_.pixels = NULL;
+  last_frame_us_ = 0;
+}
+
+bool KenBurnsStep() {
+  if (pan_.pixels == NULL) return false;
+  if (pan_.at_rest) {
+    // a redraw after the pan came to rest is not a late frame
+    last_frame_us_ = 0;
+    return false;
+  }
+  int64_t elapsed_us = esp_timer_get_time() - pan_.start_us;
+  int64_t duration_us = (int64_t)KEN_BURNS_DURATION_MS * 1000;
+  uint32_t t = elapsed_us >= duration_us
+                   ? FRACTION_ONE
+                   : (uint32_t)((elapsed_us << FRACTION_SHIFT) / duration_us);
+  pan_.at_rest = t == FRACTION_ONE;
+  t = EaseInOut(t);
+
+  // the view never leaves the photo: its right edge is at most width << 16 - scale past the
+  // origin, so the last column samples at most photo column width - 1
+  view_scale_ = Interpolate(pan_.scale[0], pan_.scale[1], t);
+  uint32_t room_x = (pan_.width << 16) - EXAMPLE_LCD_H_RES * view_scale_;
+  uint32_t room_y = (pan_.height << 16) - EXAMPLE_LCD_V_RES * view_scale_;
+  view_x_ = ((uint64_t)room_x * Interpolate(pan_.room_x[0], pan_.room_x[1], t)) >> FRACTION_SHIFT;
+  view_y_ = ((uint64_t)room_y * Interpolate(pan_.room_y[0], pan_.room_y[1], t)) >> FRACTION_SHIFT;
+  for (int x = 0; x < EXAMPLE_LCD_H_RES; x++) {
+    uint32_t pos = view_x_ + x * view_scale_;
+    column_x_[x] = pos >> 16;
+    column_weight_[x] = (pos >> 11) & 31;
+  }
+  return true;
+}
+
+void KenBurnsDraw(uint16_t* dst, int stride, int x1, int y1, int x2, int y2) {
+  if (pan_.pixels == NULL) return;
+  // photo columns the screen columns x1..x2 sample from
+  uint32_t first = column_x_[x1], last = column_x_[x2] + 1;
+  if (last >= pan_.width) last = pan_.width - 1;
+  for (int y = y1; y <= y2; y++) {
+    uint32_t pos = view_y_ + y * view_scale_;
+    uint32_t weight = (pos >> 11) & 31;
+    const uint16_t* row0 = pan_.pixels + (pos >> 16) * pan_.width;
+    if (weight == 0) {
+      for (uint32_t x = first; x <= last; x++) row_spread_[x] = Spread565(Swap565(row0[x]));
+    } else {
+      const uint16_t* row1 = row0 + pan_.width;
+      for (uint32_t x = first; x <= last; x++) {
+        row_spread_[x] = Lerp565(Spread565(Swap565(row0[x])), Spread565(Swap565(row1[x])), weight);
+      }
+    }
+    uint16_t* out = dst + (y - y1) * stride;
+    for (int x = x1; x <= x2; x++) {
+      uint32_t sx = column_x_[x], wx = column_weight_[x];
+      uint32_t v = wx ? Lerp565(row_spread_[sx], row_spread_[sx + 1], wx) : row_spread_[sx];
+      *out++ = Swap565(Pack565(v));
+    }
+  }
+
+  // the bottom rows complete a frame
+  if (y2 == EXAMPLE_LCD_V_RES - 1) {
+    int64_t now_us = esp_timer_get_time();
+    if (last_frame_us_ != 0) {
+      uint32_t interval_us = now_us - last_frame_us_;
+      LatencyRecord(LATENCY_STAGE_FRAME, interval_us);
+      if (interval_us > KEN_BURNS_FRAME_US * 3 / 2) stats_.late++;
+    }
+    last_frame_us_ = now_us;
+    stats_.frames++;
+  }
+}
+
+void GetKenBurnsStats(KenBurnsStats* stats) { *stats = stats_; }
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Ken Burns pan and zoom over photos larger than the screen (see IMAGE_LOADER_KEN_BURNS). the
+// view moves and zooms between two random spots of the photo over KEN_BURNS_DURATION_MS and
+// then rests. every frame is scaled from the full size photo with a fixed point bilinear filter,
+// straight into the LVGL draw buffers, so the overlays are still drawn on top.
+#define KEN_BURNS_ENABLED 1
+#define KEN_BURNS_FPS 30
+#define KEN_BURNS_DURATION_MS 5000
+// the closest view, in percent of the widest view of the photo (no closer than 1:1)
+#define KEN_BURNS_ZOOM_PERCENT 75
+
+typedef struct {
+  uint32_t pans;    // photos panned so far
+  uint32_t frames;  // frames drawn
+  uint32_t late;    // frames that came more than half a frame late
+} KenBurnsStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void SetKenBurnsEnabled(bool enabled);
+bool KenBurnsEnabled();
+// starts a pan over the front frame, pixels must stay valid until the next start or stop.
+// returns false (and stops the previous pan) if the photo is not larger than the screen.
+bool KenBurnsStart(const uint16_t* pixels, int width, int height);
+void KenBurnsStop();
+// moves the view to where it should be now, returns true if it moved and needs a redraw.
+// called every 1000 / KEN_BURNS_FPS ms from an LVGL timer.
+bool KenBurnsStep();
+// draws the screen area x1..x2, y1..y2 (inclusive) of the current view into dst, which points to
+// the pixel at x1, y1 and has stride pixels per row.
+void KenBurnsDraw(uint16_t* dst, int stride, int x1, int y1, int x2, int y2);
+void GetKenBurnsStats(KenBurnsStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
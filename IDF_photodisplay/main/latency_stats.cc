@@ -0,0 +1,124 @@
+#include "latency_stats.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static const char* TAG = "LATENCY";
+
+static const char* kStageNames[LATENCY_STAGE_COUNT] = {
+    "open", "read", "decode", "wait", "flush", "slide", "frame",
+};
+
+typedef struct {
+  uint32_t samples[LATENCY_RING_SIZE];
+  uint32_t next;
+  uint32_t count;
+} LatencyRing;
+
+static LatencyRing rings_[LATENCY_STAGE_COUNT];
+// the flush stage is recorded from the panel ISR, so a spinlock instead of a mutex
+static portMUX_TYPE latency_mux_ = portMUX_INITIALIZER_UNLOCKED;
+
+// 32 bit stamps (see SlideStamp()) so the flush done ISR reads them in one load, 0 when no slide
+// change is in progress
+static volatile uint32_t slide_requested_us_ = 0;
+static volatile uint32_t slide_shown_us_ = 0;
+// the flush in flight is the last area of a refresh that started after the swap
+static volatile bool flush_armed_ = false;
+
+// the low 32 bits of the clock, wraps every 71 minutes which the unsigned differences survive.
+// never 0, that means no stamp.
+static uint32_t SlideStamp() {
+  uint32_t now_us = (uint32_t)esp_timer_get_time();
+  return now_us != 0 ? now_us : 1;
+}
+
+const char* LatencyStageName(LatencyStage stage) { return kStageNames[stage]; }
+
+void LatencyRecord(LatencyStage stage, uint32_t elapsed_us) {
+  LatencyRing* ring = &rings_[stage];
+  portENTER_CRITICAL_SAFE(&latency_mux_);
+  ring->samples[ring->next] = elapsed_us;
+  ring->next = (ring->next + 1) % LATENCY_RING_SIZE;
+  ring->count++;
+  portEXIT_CRITICAL_SAFE(&latency_mux_);
+}
+
+void GetLatencySummary(LatencyStage stage, LatencySummary* summary) {
+  uint32_t sorted[LATENCY_RING_SIZE];
+  memset(summary, 0, sizeof(LatencySummary));
+  portENTER_CRITICAL(&latency_mux_);
+  summary->count = rings_[stage].count;
+  summary->samples = summary->count < LATENCY_RING_SIZE ? summary->count : LATENCY_RING_SIZE;
+  memcpy(sorted, rings_[stage].samples, summary->samples * sizeof(uint32_t));
+  portEXIT_CRITICAL(&latency_mux_);
+  if (summary->samples == 0) return;
+
+  // insertion sort, the ring is small
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < summary->samples; i++) {
+    uint32_t value = sorted[i];
+    total += value;
+    uint32_t j = i;
+    for (; j > 0 && sorted[j - 1] > value; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = value;
+  }
+  summary->min_us = sorted[0];
+  summary->max_us = sorted[summary->samples - 1];
+  summary->avg_us = total / summary->samples;
+  // nearest rank
+  summary->p95_us = sorted[(summary->samples * 95 + 99) / 100 - 1];
+}
+
+void ResetLatencyStats() {
+  portENTER_CRITICAL(&latency_mux_);
+  memset(rings_, 0, sizeof(rings_));
+  // a slide change in progress started before the reset
+  slide_requested_us_ = 0;
+  slide_shown_us_ = 0;
+  flush_armed_ = false;
+  portEXIT_CRITICAL(&latency_mux_);
+}
+
+void LogLatencyStats() {
+  for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+    LatencySummary summary;
+    GetLatencySummary((LatencyStage)i, &summary);
+    if (summary.samples == 0) continue;
+    ESP_LOGI(TAG, "%-6s n=%lu min %lu.%lu avg %lu.%lu p95 %lu.%lu max %lu.%lu ms", kStageNames[i],
+             (unsigned long)summary.count, (unsigned long)(summary.min_us / 1000),
+             (unsigned long)(summary.min_us % 1000 / 100), (unsigned long)(summary.avg_us / 1000),
+             (unsigned long)(summary.avg_us % 1000 / 100), (unsigned long)(summary.p95_us / 1000),
+             (unsigned long)(summary.p95_us % 1000 / 100), (unsigned long)(summary.max_us / 1000),
+             (unsigned long)(summary.max_us % 1000 / 100));
+  }
+}
+
+void LatencySlideRequested() {
+  // a change on top of one that is not on the panel yet keeps the first start
+  if (slide_requested_us_ == 0) slide_requested_us_ = SlideStamp();
+}
+
+void LatencySlideShown() {
+  uint32_t requested_us = slide_requested_us_;
+  if (requested_us == 0) return;
+  uint32_t shown_us = SlideStamp();
+  slide_shown_us_ = shown_us;
+  LatencyRecord(LATENCY_STAGE_WAIT, shown_us - requested_us);
+}
+
+void LatencyFlushStarted(bool last_area) {
+  flush_armed_ = last_area && slide_shown_us_ != 0;
+}
+
+void LatencyFlushDone() {
+  uint32_t requested_us = slide_requested_us_, shown_us = slide_shown_us_;
+  if (!flush_armed_ || requested_us == 0 || shown_us == 0) return;
+  flush_armed_ = false;
+  uint32_t now_us = SlideStamp();
+  LatencyRecord(LATENCY_STAGE_FLUSH, now_us - shown_us);
+  LatencyRecord(LATENCY_STAGE_SLIDE, now_us - requested_us);
+  slide_requested_us_ = 0;
+  slide_shown_us_ = 0;
+}
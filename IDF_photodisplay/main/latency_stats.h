@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// per stage latency of loading and showing photos, the last LATENCY_RING_SIZE samples of every
+// stage are kept and summarized as min / avg / p95 / max.
+#define LATENCY_RING_SIZE 64
+
+typedef enum {
+  LATENCY_STAGE_OPEN = 0,  // fopen of the photo
+  LATENCY_STAGE_READ,      // fread of a whole jpg into the file buffer
+  LATENCY_STAGE_DECODE,    // the decoder, including the reads of streamed files
+  LATENCY_STAGE_WAIT,      // slide change until its frame is swapped in, 0 on a prefetch hit
+  LATENCY_STAGE_FLUSH,     // frame swapped in until LVGL flushed the last area to the panel
+  LATENCY_STAGE_SLIDE,     // slide change until the new photo is on the panel
+  LATENCY_STAGE_FRAME,     // between two frames of a Ken Burns pan or a clip, the frame pacing
+  LATENCY_STAGE_COUNT,
+} LatencyStage;
+
+typedef struct {
+  uint32_t count;  // all samples so far, the others are over the ones in the ring
+  uint32_t samples;
+  uint32_t min_us;
+  uint32_t avg_us;
+  uint32_t p95_us;
+  uint32_t max_us;
+} LatencySummary;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char* LatencyStageName(LatencyStage stage);
+// safe to call from any task and from ISRs
+void LatencyRecord(LatencyStage stage, uint32_t elapsed_us);
+void GetLatencySummary(LatencyStage stage, LatencySummary* summary);
+void ResetLatencyStats();
+void LogLatencyStats();
+
+// slide change timeline, driven by the LVGL side: a slide change was requested, its frame was
+// swapped in, LVGL started flushing an area and the panel IO finished it (from the ISR).
+void LatencySlideRequested();
+void LatencySlideShown();
+void LatencyFlushStarted(bool last_area);
+void LatencyFlushDone();
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,23 +4,159 @@
 static const char* TAG = "LVGL";
 
 static lv_obj_t* stereo_image_ = NULL;
+// covers stereo_image_ while a photo larger than the screen is panned
+static lv_obj_t* ken_burns_view_ = NULL;
+// covers everything but the overlays while a clip plays
+static lv_obj_t* clip_view_ = NULL;
 static lv_obj_t* battery_label_ = NULL;
 static lv_img_dsc_t background_img_dsc_;
 static lv_style_t style_icon;
 static int64_t last_change_time_ = 0;
 static lv_timer_t* auto_step_timer_ = NULL;
+static lv_timer_t* frame_poll_timer_ = NULL;
+static lv_timer_t* ken_burns_timer_ = NULL;
+static lv_timer_t* clip_timer_ = NULL;
+static lv_timer_t* transition_timer_ = NULL;
+// tile hashes of the photo the panel shows under the overlays (see frame_tiles.h)
+static uint32_t shown_tiles_[FRAME_TILE_COUNT];
+static bool shown_tiles_valid_ = false;
 
 LV_FONT_DECLARE(FontAwesome30);
 
-static void UpdateImage() {
-  LoadNextImageJPG();
+// invalidates the tiles of the new photo that differ from the shown one, must hold the LVGL lock
+static void InvalidateChangedTiles(const uint32_t* tiles) {
+  FrameTileArea areas[FRAME_TILE_MAX_AREAS];
+  int count = FrameTilesDiff(shown_tiles_, tiles, areas);
+  for (int i = 0; i < count; i++) {
+    lv_area_t area = {areas[i].x1, areas[i].y1, areas[i].x2, areas[i].y2};
+    lv_obj_invalidate_area(stereo_image_, &area);
+  }
+  // same photo, the refresh of the overlays still completes the slide latency
+  if (count == 0 && battery_label_) lv_obj_invalidate(battery_label_);
+}
+
+// redraws what the panel does not show yet of the front photo, must hold the LVGL lock.
+// panel_known: the panel shows the photo the shown tiles belong to.
+static void RefreshFrontImage(bool on_panel, bool panel_known, bool ken_burns) {
+  const uint32_t* tiles = MemeGetImageTileHashes();
+  if (on_panel && battery_label_) {
+    // the photo is already on the panel, only redraw what lies on top of it
+    lv_obj_invalidate(battery_label_);
+  } else if (tiles != NULL && panel_known && !ken_burns) {
+    InvalidateChangedTiles(tiles);
+  } else {
+    lv_obj_invalidate(stereo_image_);
+  }
+  // the pan covers the photo, the panel shows none of its tiles
+  shown_tiles_valid_ = tiles != NULL && !ken_burns;
+  if (shown_tiles_valid_) memcpy(shown_tiles_, tiles, sizeof(shown_tiles_));
+}
+
+// point the background descriptor at the current front frame, must hold the LVGL lock
+static void ShowFrontImage() {
+  LatencySlideShown();
+  const uint16_t* front = (const uint16_t*)MemeGetImageBuffer();
   background_img_dsc_.header.w = MemeImageWidth();
   background_img_dsc_.header.h = MemeImageHeight();
   background_img_dsc_.data_size = MemeImageWidth() * MemeImageHeight() * 2;
-  lv_obj_invalidate(stereo_image_);
+  background_img_dsc_.data = MemeGetImageBuffer();
+  // the data pointer changes on every swap, drop the cached decoder entry of the old one
+  lv_img_cache_invalidate_src(&background_img_dsc_);
+  bool ken_burns = KenBurnsStart(front, MemeImageWidth(), MemeImageHeight());
+  if (ken_burns) {
+    lv_obj_clear_flag(ken_burns_view_, LV_OBJ_FLAG_HIDDEN);
+  } else {
+    lv_obj_add_flag(ken_burns_view_, LV_OBJ_FLAG_HIDDEN);
+  }
+  // a transition plays from slide_transition_lvgl_tick, which keeps the outgoing frame until
+  // the new photo is on the panel
+  if (!MemeImageOnPanel() && SlideTransitionStart(MemeGetOutgoingBuffer(), front)) return;
+  MemeReleaseOutgoingBuffer();
+  RefreshFrontImage(MemeImageOnPanel(), shown_tiles_valid_, ken_burns);
+}
+
+static void UpdateImage() {
+  LatencySlideRequested();
+  // on a prefetch hit the frame is swapped in right away, otherwise the loader task reads and
+  // decodes it and frame_poll_lvgl_tick shows it once ready
+  RequestLoadImage(IMAGE_LOAD_NEXT);
+  // the frames of a playing transition must not be swapped out, the frame poll picks it up
+  if (!SlideTransitionActive() && PollImageFrameReady()) {
+    ShowFrontImage();
+  }
   last_change_time_ = esp_timer_get_time();
 }
 
+static void frame_poll_lvgl_tick(lv_timer_t* t) {
+  // called from lv_timer_handler(), so the LVGL lock is already held for the swap
+  if (!SlideTransitionActive() && PollImageFrameReady()) {
+    ShowFrontImage();
+  }
+}
+
+static void ken_burns_lvgl_tick(lv_timer_t* t) {
+  // hidden under a clip
+  if (!ClipPlayerActive() && KenBurnsStep()) lv_obj_invalidate(ken_burns_view_);
+}
+
+static void slide_transition_lvgl_tick(lv_timer_t* t) {
+  SlideTransitionTickResult result = SlideTransitionStep();
+  if (result != SLIDE_TRANSITION_TICK_DONE && result != SLIDE_TRANSITION_TICK_FAILED) return;
+  MemeReleaseOutgoingBuffer();
+  // a transition that failed half way left the panel somewhere between the two photos
+  RefreshFrontImage(result == SLIDE_TRANSITION_TICK_DONE, false, false);
+}
+
+static void clip_lvgl_tick(lv_timer_t* t) {
+  switch (ClipPlayerTick()) {
+    case CLIP_TICK_FRAME:
+      lv_obj_clear_flag(clip_view_, LV_OBJ_FLAG_HIDDEN);
+      lv_obj_invalidate(clip_view_);
+      break;
+    case CLIP_TICK_ENDED:
+      // back to the photo, for a full slide interval
+      lv_obj_add_flag(clip_view_, LV_OBJ_FLAG_HIDDEN);
+      last_change_time_ = esp_timer_get_time();
+      break;
+    default:
+      break;
+  }
+}
+
+static void clip_event_cb(lv_event_t* e) {
+  lv_event_code_t code = lv_event_get_code(e);
+  if (code == LV_EVENT_COVER_CHECK) {
+    lv_event_set_cover_res(e, LV_COVER_RES_COVER);
+  } else if (code == LV_EVENT_DRAW_MAIN) {
+    lv_draw_ctx_t* draw_ctx = lv_event_get_draw_ctx(e);
+    const lv_area_t* clip = draw_ctx->clip_area;
+    const lv_area_t* buf_area = draw_ctx->buf_area;
+    int stride = lv_area_get_width(buf_area);
+    lv_color_t* dst = (lv_color_t*)draw_ctx->buf + (clip->y1 - buf_area->y1) * stride +
+                      (clip->x1 - buf_area->x1);
+    ClipPlayerDraw((uint16_t*)dst, stride, clip->x1, clip->y1, clip->x2, clip->y2);
+  } else if (code == LV_EVENT_CLICKED) {
+    ClipPlayerStop();
+  }
+}
+
+static void ken_burns_event_cb(lv_event_t* e) {
+  lv_event_code_t code = lv_event_get_code(e);
+  if (code == LV_EVENT_COVER_CHECK) {
+    // every pixel is drawn by the pan, LVGL can skip the photo underneath
+    lv_event_set_cover_res(e, LV_COVER_RES_COVER);
+  } else if (code == LV_EVENT_DRAW_MAIN) {
+    // render the clipped part of the view straight into the draw buffer
+    lv_draw_ctx_t* draw_ctx = lv_event_get_draw_ctx(e);
+    const lv_area_t* clip = draw_ctx->clip_area;
+    const lv_area_t* buf_area = draw_ctx->buf_area;
+    int stride = lv_area_get_width(buf_area);
+    lv_color_t* dst = (lv_color_t*)draw_ctx->buf + (clip->y1 - buf_area->y1) * stride +
+                      (clip->x1 - buf_area->x1);
+    KenBurnsDraw((uint16_t*)dst, stride, clip->x1, clip->y1, clip->x2, clip->y2);
+  }
+}
+
 static void event_handler_view_change(lv_event_t* e) {
   lv_event_code_t code = lv_event_get_code(e);
   if (code != LV_EVENT_CLICKED) return;
@@ -71,6 +207,7 @@ void dataupdate_lvgl_tick(lv_timer_t* t) {
   // update battery
   int32_t battery = GetBatteryPercent();
   bool charging = IsCharging();
+  SetImageLoaderCharging(charging);
   if (charging) {
     lv_obj_set_style_text_color(battery_label_, lv_color_hex(0x87ed9d), 0);
     show_charging_ = !show_charging_;
@@ -99,12 +236,14 @@ void dataupdate_lvgl_tick(lv_timer_t* t) {
   // add a loop to keep loading new image
   PowerLoop();
   int64_t boottime_ms = esp_timer_get_time();
-  if (boottime_ms - last_change_time_ > 5000000) {
+  if (boottime_ms - last_change_time_ > 5000000 && !ClipPlayerActive()) {
     UpdateImage();
   }
 }
 
 void CreateLvglPanel() {
+  InitializeSlideTransition();
+
   lv_style_init(&style_icon);
   lv_style_set_text_font(&style_icon, &FontAwesome30);
   lv_style_set_text_color(&style_icon, lv_color_hex(0xb4d2d4));
@@ -122,13 +261,27 @@ void CreateLvglPanel() {
   // lv_obj_add_flag(stereo_image_, LV_OBJ_FLAG_SCROLLABLE);
   lv_obj_add_event_cb(stereo_image_, event_handler_view_change, LV_EVENT_CLICKED, NULL);
 
-  if (LoadNextImageJPG()) {
+  ken_burns_view_ = lv_obj_create(current_screen);
+  lv_obj_remove_style_all(ken_burns_view_);
+  lv_obj_set_size(ken_burns_view_, EXAMPLE_LCD_H_RES, EXAMPLE_LCD_V_RES);
+  lv_obj_center(ken_burns_view_);
+  lv_obj_clear_flag(ken_burns_view_, LV_OBJ_FLAG_SCROLLABLE);
+  lv_obj_add_flag(ken_burns_view_, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_HIDDEN);
+  lv_obj_add_event_cb(ken_burns_view_, event_handler_view_change, LV_EVENT_CLICKED, NULL);
+  lv_obj_add_event_cb(ken_burns_view_, ken_burns_event_cb, LV_EVENT_ALL, NULL);
+
+  clip_view_ = lv_obj_create(current_screen);
+  lv_obj_remove_style_all(clip_view_);
+  lv_obj_set_size(clip_view_, EXAMPLE_LCD_H_RES, EXAMPLE_LCD_V_RES);
+  lv_obj_center(clip_view_);
+  lv_obj_clear_flag(clip_view_, LV_OBJ_FLAG_SCROLLABLE);
+  lv_obj_add_flag(clip_view_, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_HIDDEN);
+  lv_obj_add_event_cb(clip_view_, clip_event_cb, LV_EVENT_ALL, NULL);
+
+  if (LoadNextImageJPG() && MemeSwapImageBuffers()) {
     background_img_dsc_.header.always_zero = 0;
-    background_img_dsc_.header.w = MemeImageWidth();
-    background_img_dsc_.header.h = MemeImageHeight();
     background_img_dsc_.header.cf = LV_IMG_CF_TRUE_COLOR;
-    background_img_dsc_.data_size = MemeImageWidth() * MemeImageHeight() * 2;
-    background_img_dsc_.data = MemeGetImageBuffer();
+    ShowFrontImage();
     lv_img_set_src(stereo_image_, &background_img_dsc_);
   }
 
@@ -141,4 +294,8 @@ void CreateLvglPanel() {
 
   last_change_time_ = esp_timer_get_time();
   auto_step_timer_ = lv_timer_create(dataupdate_lvgl_tick, 500, NULL);
+  frame_poll_timer_ = lv_timer_create(frame_poll_lvgl_tick, 10, NULL);
+  ken_burns_timer_ = lv_timer_create(ken_burns_lvgl_tick, 1000 / KEN_BURNS_FPS, NULL);
+  clip_timer_ = lv_timer_create(clip_lvgl_tick, CLIP_TICK_MS, NULL);
+  transition_timer_ = lv_timer_create(slide_transition_lvgl_tick, SLIDE_TRANSITION_TICK_MS, NULL);
 }
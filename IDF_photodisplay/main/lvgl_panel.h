@@ -1,8 +1,13 @@
 
 
 #include "axp2101_driver.h"
+#include "clip_player.h"
 #include "display_sh86001.h"
+#include "frame_tiles.h"
 #include "image_loader.h"
+#include "ken_burns.h"
+#include "latency_stats.h"
 #include "sdmmc_driver.h"
+#include "slide_transition.h"
 
 void CreateLvglPanel();
@@ -1,6 +1,7 @@
 
 
 #include <stdio.h>
+#include "app_console.h"
 #include "axp2101_driver.h"
 #include "display_sh86001.h"
 #include "image_loader.h"
@@ -36,4 +37,8 @@ void app_main(void) {
     // Release the mutex
     example_lvgl_unlock();
   }
+
+  // the first image is loaded synchronously by CreateLvglPanel(), the rest by the loader task
+  StartImageLoaderTask();
+  StartAppConsole();
 }
@@ -0,0 +1,170 @@
+#include "photo_pack.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static_assert(sizeof(PhotoPackHeader) == PHOTO_PACK_HEADER_SIZE, "pack header layout");
+static_assert(sizeof(PhotoPackEntry) == 20, "pack entry layout");
+
+static const char* TAG = "PACK";
+
+// a plain file descriptor, pread() neither moves nor buffers anything
+static int fd_ = -1;
+static PhotoPackEntry* entries_ = NULL;
+static uint32_t entry_count_ = 0;
+static PhotoPackStats stats_;
+
+uint32_t PhotoPackChecksum(const uint8_t* data, uint32_t length) {
+  return esp_rom_crc32_le(0, data, length);
+}
+
+bool PhotoPackHeaderValid(const PhotoPackHeader* header) {
+  return header->magic == PHOTO_PACK_MAGIC && header->version == PHOTO_PACK_VERSION &&
+         header->header_size >= PHOTO_PACK_HEADER_SIZE &&
+         header->entry_size == sizeof(PhotoPackEntry) && header->entry_count > 0 &&
+         header->entry_count <= PHOTO_PACK_MAX_ENTRIES;
+}
+
+bool PhotoPackEntryValid(const PhotoPackEntry* entry, uint64_t size) {
+  return entry->length > 0 && (uint64_t)entry->offset + entry->length <= size &&
+         entry->format <= PHOTO_PACK_QOI;
+}
+
+const ImageDecoder* PhotoPackEntryDecoder(const PhotoPackEntry* entry) {
+  return entry->format == PHOTO_PACK_QOI ? &kQoiDecoder : ActiveImageDecoder();
+}
+
+// reads exactly length bytes at offset
+static bool ReadAt(uint32_t offset, void* buffer, uint32_t length) {
+  uint8_t* dst = (uint8_t*)buffer;
+  while (length > 0) {
+    ssize_t n = pread(fd_, dst, length, offset);
+    if (n <= 0) return false;
+    dst += n;
+    offset += n;
+    length -= n;
+  }
+  return true;
+}
+
+static bool ReadIndex(const char* path) {
+  struct stat st;
+  PhotoPackHeader header;
+  if (fstat(fd_, &st) != 0 || !ReadAt(0, &header, sizeof(header))) {
+    ESP_LOGE(TAG, "[SD ERROR] Failed to read the header of %s", path);
+    return false;
+  }
+  if (!PhotoPackHeaderValid(&header)) {
+    ESP_LOGE(TAG, "%s is not a version %d photo pack", path, PHOTO_PACK_VERSION);
+    return false;
+  }
+
+  uint32_t index_size = header.entry_count * sizeof(PhotoPackEntry);
+  entries_ = (PhotoPackEntry*)heap_caps_malloc(index_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (entries_ == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate the index of %lu photos", (unsigned long)header.entry_count);
+    return false;
+  }
+  if (!ReadAt(header.header_size, entries_, index_size) ||
+      PhotoPackChecksum((const uint8_t*)entries_, index_size) != header.index_checksum) {
+    ESP_LOGE(TAG, "[SD ERROR] The index of %s is broken", path);
+    return false;
+  }
+  for (uint32_t i = 0; i < header.entry_count; i++) {
+    if (!PhotoPackEntryValid(&entries_[i], st.st_size)) {
+      ESP_LOGE(TAG, "Entry %lu of %s is out of the file", (unsigned long)i, path);
+      return false;
+    }
+  }
+  entry_count_ = header.entry_count;
+  return true;
+}
+
+bool PhotoPackOpen(const char* path) {
+  PhotoPackClose();
+  fd_ = open(path, O_RDONLY);
+  // no pack is not an error, the loose files are used then
+  if (fd_ < 0) return false;
+  if (!ReadIndex(path)) {
+    PhotoPackClose();
+    return false;
+  }
+  stats_.entries = entry_count_;
+  ESP_LOGI(TAG, "%s: %lu photos", path, (unsigned long)entry_count_);
+  return true;
+}
+
+void PhotoPackClose() {
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  heap_caps_free(entries_);
+  entries_ = NULL;
+  entry_count_ = 0;
+  stats_.entries = 0;
+}
+
+uint32_t PhotoPackCount() { return entry_count_; }
+
+const PhotoPackEntry* PhotoPackGetEntry(uint32_t index) {
+  return index < entry_count_ ? &entries_[index] : NULL;
+}
+
+uint32_t PhotoPackRead(uint32_t index, uint8_t* buffer, uint32_t capacity) {
+  const PhotoPackEntry* entry = PhotoPackGetEntry(index);
+  if (entry == NULL || entry->length > capacity) return 0;
+  if (!ReadAt(entry->offset, buffer, entry->length)) {
+    ESP_LOGE(TAG, "[SD ERROR] Failed to read photo %lu. Error: %s", (unsigned long)index,
+             strerror(errno));
+    stats_.read_failed++;
+    return 0;
+  }
+  stats_.reads++;
+  stats_.bytes += entry->length;
+#if PHOTO_PACK_VERIFY
+  if (PhotoPackChecksum(buffer, entry->length) != entry->checksum) {
+    ESP_LOGE(TAG, "Photo %lu does not match its checksum", (unsigned long)index);
+    stats_.checksum_failed++;
+    return 0;
+  }
+#endif
+  return entry->length;
+}
+
+bool PhotoPackOpenStream(uint32_t index, PhotoPackStream* stream) {
+  const PhotoPackEntry* entry = PhotoPackGetEntry(index);
+  if (entry == NULL) return false;
+  stream->offset = entry->offset;
+  stream->length = entry->length;
+  stream->position = 0;
+  stats_.streams++;
+  return true;
+}
+
+int32_t PhotoPackStreamRead(void* handle, uint8_t* buffer, int32_t length) {
+  PhotoPackStream* stream = (PhotoPackStream*)handle;
+  uint32_t left = stream->length - stream->position;
+  if (length <= 0 || left == 0) return 0;
+  if ((uint32_t)length > left) length = left;
+  ssize_t n = pread(fd_, buffer, length, stream->offset + stream->position);
+  if (n <= 0) {
+    stats_.read_failed++;
+    return 0;
+  }
+  stream->position += n;
+  stats_.bytes += n;
+  return n;
+}
+
+bool PhotoPackStreamSeek(void* handle, int32_t position) {
+  PhotoPackStream* stream = (PhotoPackStream*)handle;
+  if (position < 0 || (uint32_t)position > stream->length) return false;
+  stream->position = position;
+  return true;
+}
+
+void GetPhotoPackStats(PhotoPackStats* stats) { *stats = stats_; }
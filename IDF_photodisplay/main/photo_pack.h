@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "image_decoder.h"
+
+// photo pack: the whole catalog in one file on the SD card, built on the host with
+// tools/pack_build.py. a fixed header and an index of PhotoPackEntry come first, then the photo
+// files, each starting at a sector boundary. the pack is opened once and its index kept in
+// PSRAM, so showing a photo is one positioned read instead of a FAT lookup, an open and a few
+// seeks on a file of its own. when the pack is there it replaces meta.txt and the loose files.
+#define PHOTO_PACK_PATH "/sd/prod/photos.pak"
+#define PHOTO_PACK_MAGIC 0x4b415050  // "PPAK"
+#define PHOTO_PACK_VERSION 1
+#define PHOTO_PACK_HEADER_SIZE 32
+#define PHOTO_PACK_ALIGNMENT 512
+// image ids are 16 bit
+#define PHOTO_PACK_MAX_ENTRIES 65535
+// 1: every photo read into memory is checked against the checksum of its entry (CRC-32 in ROM,
+// well under a millisecond for a photo). streamed photos are not checked.
+#define PHOTO_PACK_VERIFY 1
+
+typedef enum {
+  PHOTO_PACK_JPG = 0,
+  PHOTO_PACK_QOI,
+} PhotoPackFormat;
+
+// all fields little endian
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;  // the index starts here
+  uint32_t entry_count;
+  uint16_t entry_size;  // sizeof(PhotoPackEntry)
+  uint16_t reserved;
+  uint32_t index_checksum;  // CRC-32 of the index
+  uint32_t padding[3];
+} PhotoPackHeader;
+
+typedef struct {
+  uint32_t offset;    // from the start of the pack, a multiple of PHOTO_PACK_ALIGNMENT
+  uint32_t length;    // of the photo file
+  uint32_t checksum;  // CRC-32 (zlib) of the photo file
+  uint16_t width;     // as stored, before EXIF orientation
+  uint16_t height;
+  uint8_t format;  // PhotoPackFormat
+  uint8_t reserved[3];
+} PhotoPackEntry;
+
+// one photo of the pack as a stream for ImageDecoder::open_stream, positions are relative to
+// the start of the photo
+typedef struct {
+  uint32_t offset;
+  uint32_t length;
+  uint32_t position;
+} PhotoPackStream;
+
+typedef struct {
+  uint32_t entries;          // of the open pack, 0 if there is none
+  uint32_t reads;            // photos read into memory
+  uint32_t streams;          // photos streamed, too large for the buffer they were read into
+  uint64_t bytes;            // read for either
+  uint32_t read_failed;      // short reads
+  uint32_t checksum_failed;  // photos that did not match the checksum of their entry
+} PhotoPackStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CRC-32 as zlib computes it, of the photos and the index
+uint32_t PhotoPackChecksum(const uint8_t* data, uint32_t length);
+// the header is one this firmware reads, the index is not checked
+bool PhotoPackHeaderValid(const PhotoPackHeader* header);
+// the entry lies within the first size bytes of the pack
+bool PhotoPackEntryValid(const PhotoPackEntry* entry, uint64_t size);
+// the decoder for a photo, by its format
+const ImageDecoder* PhotoPackEntryDecoder(const PhotoPackEntry* entry);
+
+// reads and checks the header and the index, returns false (and keeps no pack open) if the file
+// is missing or broken
+bool PhotoPackOpen(const char* path);
+void PhotoPackClose();
+// entries of the open pack, 0 if there is none
+uint32_t PhotoPackCount();
+const PhotoPackEntry* PhotoPackGetEntry(uint32_t index);
+// reads the photo into buffer with one positioned read, returns its length or 0 if it does not
+// fit capacity, cannot be read or fails the checksum
+uint32_t PhotoPackRead(uint32_t index, uint8_t* buffer, uint32_t capacity);
+bool PhotoPackOpenStream(uint32_t index, PhotoPackStream* stream);
+// ImageReadCallback and ImageSeekCallback over a PhotoPackStream
+int32_t PhotoPackStreamRead(void* handle, uint8_t* buffer, int32_t length);
+bool PhotoPackStreamSeek(void* handle, int32_t position);
+void GetPhotoPackStats(PhotoPackStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,211 @@
+#include "photo_store.h"
+#include <stdio.h>
+#include <sys/stat.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "image_loader.h"
+
+static const char* TAG = "STORE";
+
+static const esp_partition_t* partition_ = NULL;
+// header and index stay mapped while the store is in use
+static const PhotoPackEntry* entries_ = NULL;
+static esp_partition_mmap_handle_t index_handle_;
+static uint32_t entry_count_ = 0;
+static uint32_t index_checksum_ = 0;
+static esp_partition_mmap_handle_t photo_handle_;
+static bool photo_mapped_ = false;
+static PhotoStoreStats stats_;
+
+static void UnmapIndex() {
+  if (entries_ != NULL) esp_partition_munmap(index_handle_);
+  entries_ = NULL;
+  entry_count_ = 0;
+  index_checksum_ = 0;
+  stats_.entries = stats_.used = 0;
+}
+
+static bool MapIndex() {
+  PhotoPackHeader header;
+  if (esp_partition_read(partition_, 0, &header, sizeof(header)) != ESP_OK ||
+      !PhotoPackHeaderValid(&header)) {
+    ESP_LOGI(TAG, "The photo store is empty");
+    return false;
+  }
+  uint32_t index_end = header.header_size + header.entry_count * sizeof(PhotoPackEntry);
+  const void* mapped;
+  if (index_end > partition_->size ||
+      esp_partition_mmap(partition_, 0, index_end, ESP_PARTITION_MMAP_DATA, &mapped,
+                         &index_handle_) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to map the index of the photo store");
+    return false;
+  }
+  entries_ = (const PhotoPackEntry*)((const uint8_t*)mapped + header.header_size);
+  bool ret = PhotoPackChecksum((const uint8_t*)entries_, header.entry_count *
+                                                             sizeof(PhotoPackEntry)) ==
+             header.index_checksum;
+  uint32_t used = index_end;
+  for (uint32_t i = 0; ret && i < header.entry_count; i++) {
+    ret = PhotoPackEntryValid(&entries_[i], partition_->size);
+    if (ret && entries_[i].offset + entries_[i].length > used) {
+      used = entries_[i].offset + entries_[i].length;
+    }
+  }
+  if (!ret) {
+    ESP_LOGE(TAG, "The index of the photo store is broken");
+    UnmapIndex();
+    return false;
+  }
+  entry_count_ = header.entry_count;
+  index_checksum_ = header.index_checksum;
+  stats_.entries = entry_count_;
+  stats_.used = used;
+  return true;
+}
+
+bool InitializePhotoStore() {
+  partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                        (esp_partition_subtype_t)PHOTO_STORE_SUBTYPE,
+                                        PHOTO_STORE_LABEL);
+  if (partition_ == NULL) {
+    ESP_LOGW(TAG, "No %s partition, see partitions.csv", PHOTO_STORE_LABEL);
+    return false;
+  }
+  stats_.size = partition_->size;
+  if (!MapIndex()) return false;
+  ESP_LOGI(TAG, "%lu photos in flash, %lu of %lu KB", (unsigned long)entry_count_,
+           (unsigned long)(stats_.used / 1024), (unsigned long)(stats_.size / 1024));
+  return true;
+}
+
+uint32_t PhotoStoreCount() { return entry_count_; }
+
+const PhotoPackEntry* PhotoStoreGetEntry(uint32_t index) {
+  return index < entry_count_ ? &entries_[index] : NULL;
+}
+
+const uint8_t* PhotoStoreMap(uint32_t index, uint32_t* length) {
+  PhotoStoreUnmap();
+  const PhotoPackEntry* entry = PhotoStoreGetEntry(index);
+  if (entry == NULL) return NULL;
+  // the offset does not have to be on an MMU page, esp_partition_mmap maps the pages around it
+  const void* mapped;
+  if (esp_partition_mmap(partition_, entry->offset, entry->length, ESP_PARTITION_MMAP_DATA,
+                         &mapped, &photo_handle_) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to map photo %lu", (unsigned long)index);
+    stats_.map_failed++;
+    return NULL;
+  }
+  photo_mapped_ = true;
+  stats_.maps++;
+  *length = entry->length;
+  return (const uint8_t*)mapped;
+}
+
+void PhotoStoreUnmap() {
+  if (photo_mapped_) esp_partition_munmap(photo_handle_);
+  photo_mapped_ = false;
+}
+
+// every photo against the checksum of its entry, once after a sync instead of on every read
+static bool VerifyPhotos() {
+  for (uint32_t i = 0; i < entry_count_; i++) {
+    uint32_t length;
+    const uint8_t* data = PhotoStoreMap(i, &length);
+    bool ret = data != NULL && PhotoPackChecksum(data, length) == entries_[i].checksum;
+    PhotoStoreUnmap();
+    if (!ret) {
+      ESP_LOGE(TAG, "Photo %lu in flash does not match its checksum", (unsigned long)i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// copies the pack behind its header into the erased partition
+static bool CopyPack(FILE* fp, uint32_t size, uint8_t* chunk) {
+  if (fseek(fp, PHOTO_PACK_HEADER_SIZE, SEEK_SET) != 0) return false;
+  for (uint32_t offset = PHOTO_PACK_HEADER_SIZE; offset < size;) {
+    uint32_t length = size - offset < PHOTO_STORE_COPY_CHUNK ? size - offset
+                                                             : PHOTO_STORE_COPY_CHUNK;
+    if (fread(chunk, 1, length, fp) != length) {
+      ESP_LOGE(TAG, "[SD ERROR] Failed to read the pack at %lu", (unsigned long)offset);
+      return false;
+    }
+    if (esp_partition_write(partition_, offset, chunk, length) != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to write the photo store at %lu", (unsigned long)offset);
+      return false;
+    }
+    offset += length;
+    if (offset / (1024 * 1024) != (offset - length) / (1024 * 1024)) {
+      ESP_LOGI(TAG, "sync %lu / %lu KB", (unsigned long)(offset / 1024),
+               (unsigned long)(size / 1024));
+    }
+  }
+  return true;
+}
+
+PhotoStoreSyncResult PhotoStoreSync(const char* pack_path, bool force) {
+  if (partition_ == NULL) {
+    ESP_LOGE(TAG, "No %s partition to sync into", PHOTO_STORE_LABEL);
+    return PHOTO_STORE_SYNC_FAILED;
+  }
+  FILE* fp = fopen(pack_path, "rb");
+  if (fp == NULL) {
+    ESP_LOGE(TAG, "Failed to open %s", pack_path);
+    return PHOTO_STORE_SYNC_FAILED;
+  }
+  struct stat st;
+  PhotoPackHeader header;
+  if (fstat(fileno(fp), &st) != 0 || fread(&header, 1, sizeof(header), fp) != sizeof(header) ||
+      !PhotoPackHeaderValid(&header)) {
+    ESP_LOGE(TAG, "%s is not a version %d photo pack", pack_path, PHOTO_PACK_VERSION);
+    fclose(fp);
+    return PHOTO_STORE_SYNC_FAILED;
+  }
+  if (!force && entry_count_ == header.entry_count && index_checksum_ == header.index_checksum) {
+    fclose(fp);
+    return PHOTO_STORE_SYNC_UP_TO_DATE;
+  }
+  uint32_t size = st.st_size;
+  uint8_t* chunk =
+      (uint8_t*)heap_caps_malloc(PHOTO_STORE_COPY_CHUNK, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if ((uint64_t)st.st_size > partition_->size || chunk == NULL) {
+    ESP_LOGE(TAG, "%s (%lu KB) does not fit the %lu KB store", pack_path,
+             (unsigned long)(st.st_size / 1024), (unsigned long)(partition_->size / 1024));
+    heap_caps_free(chunk);
+    fclose(fp);
+    return PHOTO_STORE_SYNC_FAILED;
+  }
+
+  // nothing may read the store while it is rewritten
+  PauseImageLoader();
+  PhotoStoreUnmap();
+  UnmapIndex();
+  int64_t start_us = esp_timer_get_time();
+  uint32_t erase_size =
+      (size + PHOTO_STORE_SECTOR_SIZE - 1) / PHOTO_STORE_SECTOR_SIZE * PHOTO_STORE_SECTOR_SIZE;
+  ESP_LOGI(TAG, "sync %s into flash, %lu KB", pack_path, (unsigned long)(size / 1024));
+  bool ret = esp_partition_erase_range(partition_, 0, erase_size) == ESP_OK &&
+             CopyPack(fp, size, chunk);
+  fclose(fp);
+  heap_caps_free(chunk);
+  // the header goes in last, a sync cut short leaves no valid store behind
+  ret = ret && esp_partition_write(partition_, 0, &header, sizeof(header)) == ESP_OK &&
+        MapIndex() && VerifyPhotos();
+  stats_.sync_ms = (esp_timer_get_time() - start_us) / 1000;
+  stats_.sync_bytes = size;
+  if (!ret) {
+    UnmapIndex();
+    esp_partition_erase_range(partition_, 0, PHOTO_STORE_SECTOR_SIZE);
+    ESP_LOGE(TAG, "Photo store sync failed, the store is empty");
+    return PHOTO_STORE_SYNC_ERASED;
+  }
+  ESP_LOGI(TAG, "synced %lu photos in %lu ms", (unsigned long)entry_count_,
+           (unsigned long)stats_.sync_ms);
+  return PHOTO_STORE_SYNC_DONE;
+}
+
+void GetPhotoStoreStats(PhotoStoreStats* stats) { *stats = stats_; }
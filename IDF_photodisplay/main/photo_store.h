@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "photo_pack.h"
+
+// photo store: a photo pack (see photo_pack.h) copied from the SD card into the "photos" data
+// partition of the flash. the photos are mapped into the address space with esp_partition_mmap
+// and the decoder reads them in place, no copy into a file buffer and no SD card needed, so the
+// slideshow keeps running with a missing or flaky card. the loader prefers the store over the
+// pack on the SD card and the loose files.
+#define PHOTO_STORE_LABEL "photos"
+// custom data subtype, see partitions.csv
+#define PHOTO_STORE_SUBTYPE 0x40
+// the pack a sync copies into the store
+#define PHOTO_STORE_SOURCE PHOTO_PACK_PATH
+// SD to flash copy buffer, internal RAM
+#define PHOTO_STORE_COPY_CHUNK (16 * 1024)
+#define PHOTO_STORE_SECTOR_SIZE 4096
+
+typedef enum {
+  PHOTO_STORE_SYNC_UP_TO_DATE = 0,  // the store already holds that pack, nothing was written
+  PHOTO_STORE_SYNC_DONE,            // the pack was written and checked, restart to use it
+  PHOTO_STORE_SYNC_FAILED,          // nothing was written (no partition, no pack or too large)
+  PHOTO_STORE_SYNC_ERASED,          // failed after the erase, the store is empty until a sync
+} PhotoStoreSyncResult;
+
+typedef struct {
+  uint32_t size;         // of the partition, 0 if there is none
+  uint32_t used;         // bytes of the pack in the store
+  uint32_t entries;      // photos in the store
+  uint32_t maps;         // photos mapped for a decode
+  uint32_t map_failed;   // mmap errors, address space running out
+  uint32_t sync_ms;      // duration of the last sync
+  uint32_t sync_bytes;   // written by the last sync
+} PhotoStoreStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// finds the partition and maps the index of the pack in it, returns false if there is no
+// partition or no valid pack in it
+bool InitializePhotoStore();
+// photos in the store, 0 if it is empty
+uint32_t PhotoStoreCount();
+const PhotoPackEntry* PhotoStoreGetEntry(uint32_t index);
+// maps the photo and returns a pointer to it in flash, valid until PhotoStoreUnmap(). one photo
+// is mapped at a time, NULL if the mapping failed.
+const uint8_t* PhotoStoreMap(uint32_t index, uint32_t* length);
+void PhotoStoreUnmap();
+// copies the pack at pack_path into the store unless the store already holds it (same index),
+// force copies it anyway. the image loader is paused from the erase on and stays paused, the
+// caller restarts after PHOTO_STORE_SYNC_DONE or PHOTO_STORE_SYNC_ERASED. takes a minute or so
+// for a full partition, not from the LVGL task.
+PhotoStoreSyncResult PhotoStoreSync(const char* pack_path, bool force);
+void GetPhotoStoreStats(PhotoStoreStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
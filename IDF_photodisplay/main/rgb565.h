@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// RGB565 blending for the preview upscale, the Ken Burns pan and the slide transitions.
+// a spread pixel has the green field moved to the upper half word, which leaves room for a
+// 5 bit weight in every channel, so one multiply scales all three channels.
+static inline uint32_t Spread565(uint16_t pixel) {
+  return (pixel | ((uint32_t)pixel << 16)) & 0x07e0f81f;
+}
+
+static inline uint16_t Pack565(uint32_t spread) { return (uint16_t)(spread | (spread >> 16)); }
+
+// spread pixels, weight is in 1/32 towards b
+static inline uint32_t Lerp565(uint32_t a, uint32_t b, uint32_t weight) {
+  return ((a * (32 - weight) + b * weight) >> 5) & 0x07e0f81f;
+}
+
+// big endian (the frames and the panel) to native order and back
+static inline uint16_t Swap565(uint16_t pixel) { return (uint16_t)((pixel >> 8) | (pixel << 8)); }
@@ -0,0 +1,268 @@
+#include "sd_bench.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "image_loader.h"
+#include "sdmmc_driver.h"
+
+static const char* TAG = "SDBENCH";
+
+static const uint32_t kBlocks[] = SD_BENCH_BLOCKS;
+#define SD_BENCH_BLOCK_COUNT (sizeof(kBlocks) / sizeof(kBlocks[0]))
+#define SD_BENCH_WRITE_BLOCK (32 * 1024)
+
+// per operation latency of the test running, the most operations are the reads of the test file
+// with the smallest block
+static uint32_t* samples_ = NULL;
+static uint32_t sample_capacity_ = 0;
+
+static int CompareSamples(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+// one row of the report over the first ops samples, sorts them
+static void PrintRow(FILE* out, const char* test, uint32_t block, uint32_t ops, uint64_t bytes,
+                     int64_t elapsed_us) {
+  if (ops == 0) return;
+  qsort(samples_, ops, sizeof(uint32_t), CompareSamples);
+  uint64_t sum_us = 0;
+  for (uint32_t i = 0; i < ops; i++) sum_us += samples_[i];
+  if (elapsed_us <= 0) elapsed_us = 1;
+  fprintf(out, "%s,%lu,%lu,%llu,%lu,%lu,%lu,%lu,%lu\n", test, (unsigned long)block,
+          (unsigned long)ops, (unsigned long long)bytes, (unsigned long)(elapsed_us / 1000),
+          (unsigned long)(bytes * 1000000 / 1024 / elapsed_us), (unsigned long)(sum_us / ops),
+          (unsigned long)samples_[(ops - 1) * 95 / 100], (unsigned long)samples_[ops - 1]);
+}
+
+static void SmallFilePath(char* path, size_t size, uint32_t index) {
+  snprintf(path, size, SD_BENCH_FILES_DIR "/%05lu.bin", (unsigned long)index);
+}
+
+static bool MakeDir(const char* path) {
+  if (mkdir(path, 0775) == 0 || errno == EEXIST) return true;
+  ESP_LOGE(TAG, "[SD ERROR] Failed to create %s. Error: %s", path, strerror(errno));
+  return false;
+}
+
+// the test file is kept between runs, creating it is the write test
+static bool PrepareTestFile(FILE* out, uint8_t* buffer) {
+  struct stat st;
+  if (stat(SD_BENCH_FILE, &st) == 0 && st.st_size == SD_BENCH_FILE_SIZE) return true;
+  ESP_LOGI(TAG, "creating %s, %d KB", SD_BENCH_FILE, SD_BENCH_FILE_SIZE / 1024);
+  // random data, nothing on the way can make it smaller
+  for (uint32_t i = 0; i < SD_BENCH_WRITE_BLOCK; i += 4) {
+    uint32_t value = esp_random();
+    memcpy(buffer + i, &value, 4);
+  }
+  int fd = open(SD_BENCH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+  if (fd < 0) {
+    ESP_LOGE(TAG, "[SD ERROR] Failed to create %s. Error: %s", SD_BENCH_FILE, strerror(errno));
+    return false;
+  }
+  uint32_t ops = 0;
+  bool ret = true;
+  int64_t start_us = esp_timer_get_time();
+  for (uint32_t offset = 0; ret && offset < SD_BENCH_FILE_SIZE; offset += SD_BENCH_WRITE_BLOCK) {
+    int64_t op_us = esp_timer_get_time();
+    ret = write(fd, buffer, SD_BENCH_WRITE_BLOCK) == SD_BENCH_WRITE_BLOCK;
+    samples_[ops++] = esp_timer_get_time() - op_us;
+  }
+  ret = close(fd) == 0 && ret;
+  int64_t elapsed_us = esp_timer_get_time() - start_us;
+  if (!ret) {
+    ESP_LOGE(TAG, "[SD ERROR] Failed to write %s, card full?", SD_BENCH_FILE);
+    unlink(SD_BENCH_FILE);
+    return false;
+  }
+  PrintRow(out, "write", SD_BENCH_WRITE_BLOCK, ops, SD_BENCH_FILE_SIZE, elapsed_us);
+  return true;
+}
+
+// creates the small files that are missing, earlier runs leave theirs behind
+static bool PrepareSmallFiles(uint32_t file_count, const uint8_t* data) {
+  if (!MakeDir(SD_BENCH_FILES_DIR)) return false;
+  char path[48];
+  struct stat st;
+  uint32_t created = 0;
+  for (uint32_t i = 0; i < file_count; i++) {
+    SmallFilePath(path, sizeof(path), i);
+    if (stat(path, &st) == 0 && st.st_size == SD_BENCH_SMALL_FILE) continue;
+    FILE* fp = fopen(path, "wb");
+    bool ret = fp != NULL && fwrite(data, 1, SD_BENCH_SMALL_FILE, fp) == SD_BENCH_SMALL_FILE;
+    if (fp != NULL) ret = fclose(fp) == 0 && ret;
+    if (!ret) {
+      ESP_LOGE(TAG, "[SD ERROR] Failed to create %s, card full?", path);
+      return false;
+    }
+    created++;
+  }
+  if (created > 0) ESP_LOGI(TAG, "created %lu small files", (unsigned long)created);
+  return true;
+}
+
+static bool SequentialRead(FILE* out, uint8_t* buffer, uint32_t block) {
+  int fd = open(SD_BENCH_FILE, O_RDONLY);
+  if (fd < 0) return false;
+  uint32_t ops = 0;
+  uint64_t bytes = 0;
+  int64_t start_us = esp_timer_get_time();
+  while (ops < sample_capacity_) {
+    int64_t op_us = esp_timer_get_time();
+    ssize_t n = read(fd, buffer, block);
+    if (n <= 0) break;
+    samples_[ops++] = esp_timer_get_time() - op_us;
+    bytes += n;
+  }
+  int64_t elapsed_us = esp_timer_get_time() - start_us;
+  close(fd);
+  if (bytes != SD_BENCH_FILE_SIZE) {
+    ESP_LOGE(TAG, "[SD ERROR] Short read of %s at %lu B blocks", SD_BENCH_FILE,
+             (unsigned long)block);
+    return false;
+  }
+  PrintRow(out, "seq_read", block, ops, bytes, elapsed_us);
+  return true;
+}
+
+static bool RandomRead(FILE* out, uint8_t* buffer) {
+  int fd = open(SD_BENCH_FILE, O_RDONLY);
+  if (fd < 0) return false;
+  const uint32_t positions = SD_BENCH_FILE_SIZE / SD_BENCH_RANDOM_BLOCK;
+  bool ret = true;
+  int64_t start_us = esp_timer_get_time();
+  for (uint32_t i = 0; ret && i < SD_BENCH_RANDOM_READS; i++) {
+    uint32_t offset = esp_random() % positions * SD_BENCH_RANDOM_BLOCK;
+    int64_t op_us = esp_timer_get_time();
+    ret = pread(fd, buffer, SD_BENCH_RANDOM_BLOCK, offset) == SD_BENCH_RANDOM_BLOCK;
+    samples_[i] = esp_timer_get_time() - op_us;
+  }
+  int64_t elapsed_us = esp_timer_get_time() - start_us;
+  close(fd);
+  if (!ret) {
+    ESP_LOGE(TAG, "[SD ERROR] Random read of %s failed", SD_BENCH_FILE);
+    return false;
+  }
+  PrintRow(out, "rand_read", SD_BENCH_RANDOM_BLOCK, SD_BENCH_RANDOM_READS,
+           (uint64_t)SD_BENCH_RANDOM_READS * SD_BENCH_RANDOM_BLOCK, elapsed_us);
+  return true;
+}
+
+typedef enum {
+  SMALL_FILE_STAT = 0,
+  SMALL_FILE_OPEN,
+  SMALL_FILE_FIRST_READ,
+} SmallFileTest;
+
+// one pass over the small files in the order given
+static bool SmallFilePass(FILE* out, SmallFileTest test, const uint32_t* order,
+                          uint32_t file_count, uint8_t* buffer) {
+  static const char* kNames[] = {"stat", "fopen", "first_read"};
+  char path[48];
+  struct stat st;
+  bool ret = true;
+  int64_t start_us = esp_timer_get_time();
+  for (uint32_t i = 0; ret && i < file_count; i++) {
+    SmallFilePath(path, sizeof(path), order[i]);
+    FILE* fp = NULL;
+    int64_t op_us = esp_timer_get_time();
+    if (test == SMALL_FILE_STAT) {
+      ret = stat(path, &st) == 0;
+    } else {
+      fp = fopen(path, "rb");
+      ret = fp != NULL;
+      if (ret && test == SMALL_FILE_FIRST_READ) {
+        ret = fread(buffer, 1, SD_BENCH_SMALL_FILE, fp) == SD_BENCH_SMALL_FILE;
+      }
+    }
+    samples_[i] = esp_timer_get_time() - op_us;
+    // the fclose of a file opened for reading writes nothing, it stays out of the time
+    if (fp != NULL) fclose(fp);
+  }
+  int64_t elapsed_us = esp_timer_get_time() - start_us;
+  if (!ret) {
+    ESP_LOGE(TAG, "[SD ERROR] %s of %s failed", kNames[test], path);
+    return false;
+  }
+  uint64_t bytes = test == SMALL_FILE_FIRST_READ ? (uint64_t)file_count * SD_BENCH_SMALL_FILE : 0;
+  PrintRow(out, kNames[test], test == SMALL_FILE_FIRST_READ ? SD_BENCH_SMALL_FILE : 0, file_count,
+           bytes, elapsed_us);
+  return true;
+}
+
+static bool SmallFileTests(FILE* out, uint32_t file_count, uint8_t* buffer) {
+  uint32_t* order = (uint32_t*)heap_caps_malloc(file_count * sizeof(uint32_t),
+                                                MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (order == NULL) return false;
+  // random order, a run of neighbouring directory entries would hit the FAT cache
+  for (uint32_t i = 0; i < file_count; i++) order[i] = i;
+  for (uint32_t i = file_count - 1; i > 0; i--) {
+    uint32_t j = esp_random() % (i + 1);
+    uint32_t tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+  bool ret = SmallFilePass(out, SMALL_FILE_STAT, order, file_count, buffer) &&
+             SmallFilePass(out, SMALL_FILE_OPEN, order, file_count, buffer) &&
+             SmallFilePass(out, SMALL_FILE_FIRST_READ, order, file_count, buffer);
+  heap_caps_free(order);
+  return ret;
+}
+
+bool RunSdBenchmark(uint32_t file_count, FILE* out) {
+  SdmmcBusInfo bus;
+  GetSdmmcBusInfo(&bus);
+  if (bus.width == 0) {
+    ESP_LOGE(TAG, "No SD card mounted");
+    return false;
+  }
+  if (file_count == 0) file_count = SD_BENCH_DEFAULT_FILES;
+  if (file_count > SD_BENCH_MAX_FILES) file_count = SD_BENCH_MAX_FILES;
+
+  uint32_t max_block = SD_BENCH_WRITE_BLOCK;
+  uint32_t min_block = kBlocks[0];
+  for (uint32_t i = 0; i < SD_BENCH_BLOCK_COUNT; i++) {
+    if (kBlocks[i] > max_block) max_block = kBlocks[i];
+    if (kBlocks[i] < min_block) min_block = kBlocks[i];
+  }
+  sample_capacity_ = SD_BENCH_FILE_SIZE / min_block;
+  if (sample_capacity_ < SD_BENCH_RANDOM_READS) sample_capacity_ = SD_BENCH_RANDOM_READS;
+  if (sample_capacity_ < file_count) sample_capacity_ = file_count;
+  samples_ = (uint32_t*)heap_caps_malloc(sample_capacity_ * sizeof(uint32_t),
+                                         MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  uint8_t* buffer = (uint8_t*)heap_caps_malloc(max_block, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (samples_ == NULL || buffer == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate the benchmark buffers");
+    heap_caps_free(samples_);
+    heap_caps_free(buffer);
+    samples_ = NULL;
+    return false;
+  }
+
+  // the loader would share the card with the tests
+  PauseImageLoader();
+  fprintf(out, "# sd card %lu MB, %d bit bus at %d kHz, %lu small files\n",
+          (unsigned long)SDCard_Size, bus.width, bus.real_freq_khz, (unsigned long)file_count);
+  fprintf(out, "test,block,ops,bytes,ms,kb_per_s,avg_us,p95_us,max_us\n");
+  bool ret = MakeDir(SD_BENCH_DIR) && PrepareTestFile(out, buffer) &&
+             PrepareSmallFiles(file_count, buffer);
+  for (uint32_t i = 0; ret && i < SD_BENCH_BLOCK_COUNT; i++) {
+    ret = SequentialRead(out, buffer, kBlocks[i]);
+  }
+  ret = ret && RandomRead(out, buffer) && SmallFileTests(out, file_count, buffer);
+  fflush(out);
+  ResumeImageLoader();
+
+  heap_caps_free(samples_);
+  heap_caps_free(buffer);
+  samples_ = NULL;
+  return ret;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// SD card benchmark, run from the "sdbench" console command to qualify a card and to pick the
+// read sizes of the loader. it works on the mounted file system under SD_BENCH_DIR and writes a
+// CSV report, one row per test:
+//   test,block,ops,bytes,ms,kb_per_s,avg_us,p95_us,max_us
+//   write       the sequential write of the test file, only when it had to be created
+//   seq_read    sequential read() of the test file, once per block size in SD_BENCH_BLOCKS
+//   rand_read   pread() of SD_BENCH_RANDOM_BLOCK at random aligned offsets of the test file
+//   stat        stat() of every file in a directory of N small files, in random order
+//   fopen       fopen() + fclose() of those files
+//   first_read  fopen() until the first SD_BENCH_SMALL_FILE bytes are read, as the loader does
+// the reads go into a PSRAM buffer like the file buffer of the loader, the image loader is
+// paused while the benchmark runs.
+#define SD_BENCH_DIR "/sd/sdbench"
+#define SD_BENCH_FILE SD_BENCH_DIR "/seq.bin"
+#define SD_BENCH_FILE_SIZE (4 * 1024 * 1024)
+#define SD_BENCH_BLOCKS {512, 4096, 16384, 32768, 65536, 131072}
+#define SD_BENCH_RANDOM_BLOCK 4096
+#define SD_BENCH_RANDOM_READS 256
+// the N small files, created once and reused by later runs with the same or a smaller N
+#define SD_BENCH_FILES_DIR SD_BENCH_DIR "/files"
+#define SD_BENCH_SMALL_FILE 4096
+#define SD_BENCH_DEFAULT_FILES 200
+#define SD_BENCH_MAX_FILES 2000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// runs all tests with file_count small files and writes the report to out, returns false if a
+// test could not run (card full, no card, out of memory). takes half a minute or so on a first
+// run that creates the files, not from the LVGL task.
+bool RunSdBenchmark(uint32_t file_count, FILE* out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,8 @@
 
 #include "sdmmc_driver.h"
 #include "dirent.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 
@@ -93,6 +95,66 @@ int32_t ParameterGetCurrentTab() {
   return value;
 }
 
+void ParameterSetImageDecoder(int32_t value) {
+  if (nvs_set_i32(my_handle, "decoder", value) == ESP_OK) {
+    nvs_commit(my_handle);
+  }
+}
+
+int32_t ParameterGetImageDecoder(int32_t default_value) {
+  int32_t value = default_value;
+  nvs_get_i32(my_handle, "decoder", &value);
+  return value;
+}
+
+void ParameterSetSlideTransition(int32_t value) {
+  if (nvs_set_i32(my_handle, "trans", value) == ESP_OK) {
+    nvs_commit(my_handle);
+  }
+}
+
+int32_t ParameterGetSlideTransition(int32_t default_value) {
+  int32_t value = default_value;
+  nvs_get_i32(my_handle, "trans", &value);
+  return value;
+}
+
+void ParameterSetSlideTransitionMs(int32_t value) {
+  if (nvs_set_i32(my_handle, "trans_ms", value) == ESP_OK) {
+    nvs_commit(my_handle);
+  }
+}
+
+int32_t ParameterGetSlideTransitionMs(int32_t default_value) {
+  int32_t value = default_value;
+  nvs_get_i32(my_handle, "trans_ms", &value);
+  return value;
+}
+
+void ParameterSetSdmmcBusWidth(int32_t value) {
+  if (nvs_set_i32(my_handle, "sd_width", value) == ESP_OK) {
+    nvs_commit(my_handle);
+  }
+}
+
+int32_t ParameterGetSdmmcBusWidth(int32_t default_value) {
+  int32_t value = default_value;
+  nvs_get_i32(my_handle, "sd_width", &value);
+  return value;
+}
+
+void ParameterSetSdmmcFreqKhz(int32_t value) {
+  if (nvs_set_i32(my_handle, "sd_khz", value) == ESP_OK) {
+    nvs_commit(my_handle);
+  }
+}
+
+int32_t ParameterGetSdmmcFreqKhz(int32_t default_value) {
+  int32_t value = default_value;
+  nvs_get_i32(my_handle, "sd_khz", &value);
+  return value;
+}
+
 uint32_t SDCard_Size = 0;
 uint32_t SDCard_Free_Size = 0;
 
@@ -109,6 +171,89 @@ static void print_sd_free_space_fatfs() {
   ESP_LOGI(TAG, "Total: %ld MB, Free: %ld MB", SDCard_Size, SDCard_Free_Size);
 }
 
+// the bus settings from the fastest down, the mount starts at the configured one
+typedef struct {
+  int width;
+  int freq_khz;
+} SdmmcBusSetting;
+
+static const SdmmcBusSetting kSdmmcBusSettings[] = {
+    {4, SDMMC_FREQ_HIGHSPEED},
+    {4, SDMMC_FREQ_DEFAULT},
+    {1, SDMMC_FREQ_HIGHSPEED},
+    {1, SDMMC_FREQ_DEFAULT},
+};
+#define SDMMC_BUS_SETTING_COUNT ((int)(sizeof(kSdmmcBusSettings) / sizeof(kSdmmcBusSettings[0])))
+
+static sdmmc_card_t* card_ = NULL;
+static SdmmcBusInfo bus_info_;
+
+// the first setting that is not faster than the configured one
+static int FirstBusSetting() {
+  int width = ParameterGetSdmmcBusWidth(0);
+  int freq_khz = ParameterGetSdmmcFreqKhz(0);
+  if (width != 1 && width != 4) width = SDMMC_BUS_WIDTH;
+  if (freq_khz <= 0) freq_khz = SDMMC_BUS_FREQ_KHZ;
+  for (int i = 0; i < SDMMC_BUS_SETTING_COUNT; i++) {
+    if (kSdmmcBusSettings[i].width <= width && kSdmmcBusSettings[i].freq_khz <= freq_khz) {
+      return i;
+    }
+  }
+  return SDMMC_BUS_SETTING_COUNT - 1;
+}
+
+// reads the first sectors twice, a marginal bus shows up as a read error (the host checks the
+// CRC of every block) or as two reads that differ
+static bool SdmmcReadTest(sdmmc_card_t* card, uint8_t* buffer) {
+  uint32_t crc = 0;
+  for (int i = 0; i < 2; i++) {
+    esp_err_t ret = sdmmc_read_sectors(card, buffer, 0, SDMMC_TEST_SECTORS);
+    if (ret != ESP_OK) {
+      ESP_LOGW(TAG, "Read test failed (%s)", esp_err_to_name(ret));
+      return false;
+    }
+    uint32_t read_crc = esp_rom_crc32_le(0, buffer, SDMMC_TEST_SECTORS * card->csd.sector_size);
+    if (i > 0 && read_crc != crc) {
+      ESP_LOGW(TAG, "Read test failed, the two reads differ");
+      return false;
+    }
+    crc = read_crc;
+  }
+  return true;
+}
+
+uint32_t SdmmcProbeThroughput() {
+  if (card_ == NULL) return 0;
+  uint8_t* buffer = (uint8_t*)heap_caps_malloc(SDMMC_PROBE_CHUNK, MALLOC_CAP_DMA);
+  if (buffer == NULL) return 0;
+  uint32_t sector_size = card_->csd.sector_size;
+  uint32_t chunk_sectors = SDMMC_PROBE_CHUNK / sector_size;
+  uint32_t sectors = SDMMC_PROBE_BYTES / sector_size;
+  if (sectors > (uint32_t)card_->csd.capacity) sectors = card_->csd.capacity;
+
+  int64_t start_us = esp_timer_get_time();
+  esp_err_t ret = ESP_OK;
+  for (uint32_t sector = 0; ret == ESP_OK && sector < sectors; sector += chunk_sectors) {
+    uint32_t count = sectors - sector < chunk_sectors ? sectors - sector : chunk_sectors;
+    ret = sdmmc_read_sectors(card_, buffer, sector, count);
+  }
+  int64_t elapsed_us = esp_timer_get_time() - start_us;
+  heap_caps_free(buffer);
+  if (ret != ESP_OK || elapsed_us <= 0) {
+    ESP_LOGE(TAG, "[SD ERROR] Read probe failed (%s)", esp_err_to_name(ret));
+    return 0;
+  }
+  uint64_t bytes = (uint64_t)sectors * sector_size;
+  bus_info_.probe_kb_per_s = bytes * 1000000 / 1024 / elapsed_us;
+  ESP_LOGI(TAG, "Sequential read: %lu KB in %lu ms, %lu.%02lu MB/s",
+           (unsigned long)(bytes / 1024), (unsigned long)(elapsed_us / 1000),
+           (unsigned long)(bus_info_.probe_kb_per_s / 1024),
+           (unsigned long)(bus_info_.probe_kb_per_s % 1024 * 100 / 1024));
+  return bus_info_.probe_kb_per_s;
+}
+
+void GetSdmmcBusInfo(SdmmcBusInfo* info) { *info = bus_info_; }
+
 void LoadAndTestSDMMC(void) {
   esp_err_t ret;
 
@@ -134,9 +279,7 @@ void LoadAndTestSDMMC(void) {
 
   ESP_LOGI(TAG, "Using SDMMC peripheral");
 
-  // By default, SD card frequency is initialized to SDMMC_FREQ_DEFAULT (20MHz)
-  // For setting a specific frequency, use host.max_freq_khz (range 400kHz - 40MHz for SDMMC)
-  // Example: for fixed frequency of 10MHz, use host.max_freq_khz = 10000;
+  // the frequency is set per bus setting below (host.max_freq_khz, 400kHz - 40MHz for SDMMC)
   sdmmc_host_t host = SDMMC_HOST_DEFAULT();
 
   // For SoCs where the SD power can be supplied both via an internal or external (e.g. on-board
@@ -160,21 +303,50 @@ void LoadAndTestSDMMC(void) {
   // This initializes the slot without card detect (CD) and write protect (WP) signals.
   // Modify slot_config.gpio_cd and slot_config.gpio_wp if your board has these signals.
   sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
-  slot_config.width = 1;
 
   // On chips where the GPIOs used for SD card can be configured, set them in
   // the slot_config structure:
-  slot_config.clk = GPIO_NUM_2;
-  slot_config.cmd = GPIO_NUM_1;
-  slot_config.d0 = GPIO_NUM_3;
+  slot_config.clk = SDMMC_PIN_CLK;
+  slot_config.cmd = SDMMC_PIN_CMD;
+  slot_config.d0 = SDMMC_PIN_D0;
+  slot_config.d1 = SDMMC_PIN_D1;
+  slot_config.d2 = SDMMC_PIN_D2;
+  slot_config.d3 = SDMMC_PIN_D3;
 
   // Enable internal pullups on enabled pins. The internal pullups
   // are insufficient however, please make sure 10k external pullups are
   // connected on the bus. This is for debug / example purpose only.
   slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
 
-  ESP_LOGI(TAG, "Mounting filesystem");
-  ret = esp_vfs_fat_sdmmc_mount(mount_point, &host, &slot_config, &mount_config, &card);
+  bool has_4_bit_pins =
+      SDMMC_PIN_D1 != GPIO_NUM_NC && SDMMC_PIN_D2 != GPIO_NUM_NC && SDMMC_PIN_D3 != GPIO_NUM_NC;
+  uint8_t* test_buffer = (uint8_t*)heap_caps_malloc(SDMMC_TEST_SECTORS * 512, MALLOC_CAP_DMA);
+  ret = ESP_ERR_NOT_FOUND;
+  for (int i = FirstBusSetting(); i < SDMMC_BUS_SETTING_COUNT; i++) {
+    const SdmmcBusSetting* setting = &kSdmmcBusSettings[i];
+    if (setting->width == 4 && !has_4_bit_pins) continue;
+    slot_config.width = setting->width;
+    host.max_freq_khz = setting->freq_khz;
+    ESP_LOGI(TAG, "Mounting filesystem, %d bit bus at %d kHz", setting->width, setting->freq_khz);
+    ret = esp_vfs_fat_sdmmc_mount(mount_point, &host, &slot_config, &mount_config, &card);
+    // ESP_FAIL: the card works but holds no FAT file system, a slower bus does not change that
+    if (ret == ESP_FAIL) break;
+    if (ret == ESP_OK && (test_buffer == NULL || SdmmcReadTest(card, test_buffer))) {
+      bus_info_.width = setting->width;
+      bus_info_.freq_khz = setting->freq_khz;
+      bus_info_.real_freq_khz = card->real_freq_khz;
+      break;
+    }
+    if (ret == ESP_OK) {
+      esp_vfs_fat_sdcard_unmount(mount_point, card);
+      ret = ESP_ERR_INVALID_RESPONSE;
+    } else {
+      ESP_LOGW(TAG, "Card init failed at %d bit, %d kHz (%s)", setting->width,
+               setting->freq_khz, esp_err_to_name(ret));
+    }
+    bus_info_.fallbacks++;
+  }
+  heap_caps_free(test_buffer);
 
   if (ret != ESP_OK) {
     if (ret == ESP_FAIL) {
@@ -195,9 +367,12 @@ void LoadAndTestSDMMC(void) {
   }
 
   // Card has been initialized, print its properties
+  card_ = card;
   sdmmc_card_print_info(stdout, card);
   print_sd_free_space_fatfs();
-  ESP_LOGI(TAG, "Filesystem mounted");
+  ESP_LOGI(TAG, "Filesystem mounted, %d bit bus at %d kHz", bus_info_.width,
+           bus_info_.real_freq_khz);
+  SdmmcProbeThroughput();
 
   // ListAllFilesInFolder(MOUNT_POINT);
 }
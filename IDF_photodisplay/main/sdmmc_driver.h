@@ -1,3 +1,5 @@
+#pragma once
+
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/unistd.h>
@@ -27,6 +29,35 @@
 
 #define BOOT_KEY_Input_PIN 0
 
+// SD bus. the card is mounted with SDMMC_BUS_WIDTH data lines at SDMMC_BUS_FREQ_KHZ, unless the
+// "sdbus" console command stored another setting in NVS. if the card does not initialize at that
+// setting or fails the read test (the same sectors read twice and compared by CRC), the mount
+// falls back through the slower ones: 4 bit at 40 MHz, 4 bit at 20 MHz, 1 bit at 40 MHz, 1 bit
+// at 20 MHz. the default is the 20 MHz the board always used, 40 MHz is opt in with "sdbus".
+#define SDMMC_BUS_WIDTH 1
+#define SDMMC_BUS_FREQ_KHZ SDMMC_FREQ_DEFAULT
+#define SDMMC_PIN_CLK GPIO_NUM_2
+#define SDMMC_PIN_CMD GPIO_NUM_1
+#define SDMMC_PIN_D0 GPIO_NUM_3
+// the 4 bit bus also needs D1 ~ D3, this board only routes D0 to the card slot. while they are
+// GPIO_NUM_NC the 4 bit settings are skipped.
+#define SDMMC_PIN_D1 GPIO_NUM_NC
+#define SDMMC_PIN_D2 GPIO_NUM_NC
+#define SDMMC_PIN_D3 GPIO_NUM_NC
+// read test at mount, from the start of the card
+#define SDMMC_TEST_SECTORS 64
+// sequential read probe at mount, the MB/s it gets are logged
+#define SDMMC_PROBE_BYTES (512 * 1024)
+#define SDMMC_PROBE_CHUNK (32 * 1024)
+
+typedef struct {
+  int width;          // data lines in use, 0 when no card is mounted
+  int freq_khz;       // asked for
+  int real_freq_khz;  // what the host clock divider gives
+  int fallbacks;      // settings that failed before this one
+  uint32_t probe_kb_per_s;  // last sequential read probe
+} SdmmcBusInfo;
+
 extern uint32_t SDCard_Size;
 extern uint32_t SDCard_Free_Size;
 
@@ -44,6 +75,21 @@ void ParameterManagerInit();
 int32_t ParameterGetBootCount();
 void ParameterSetCurrentTab(int32_t value);
 int32_t ParameterGetCurrentTab();
+void ParameterSetImageDecoder(int32_t value);
+int32_t ParameterGetImageDecoder(int32_t default_value);
+void ParameterSetSlideTransition(int32_t value);
+int32_t ParameterGetSlideTransition(int32_t default_value);
+void ParameterSetSlideTransitionMs(int32_t value);
+int32_t ParameterGetSlideTransitionMs(int32_t default_value);
+// 0 when no bus setting is stored
+void ParameterSetSdmmcBusWidth(int32_t value);
+int32_t ParameterGetSdmmcBusWidth(int32_t default_value);
+void ParameterSetSdmmcFreqKhz(int32_t value);
+int32_t ParameterGetSdmmcFreqKhz(int32_t default_value);
+
+void GetSdmmcBusInfo(SdmmcBusInfo* info);
+// the sequential read probe, returns KB/s or 0 if there is no card or the read failed
+uint32_t SdmmcProbeThroughput();
 
 #ifdef __cplusplus
 }
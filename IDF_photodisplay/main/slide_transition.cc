@@ -0,0 +1,213 @@
+#include "slide_transition.h"
+#include <string.h>
+#include "display_sh86001.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lvgl.h"
+#include "rgb565.h"
+#include "sdmmc_driver.h"
+
+static const char* TAG = "TRANSITION";
+
+// transition progress is fixed point, PROGRESS_ONE is the end
+#define PROGRESS_SHIFT 10
+#define PROGRESS_ONE (1 << PROGRESS_SHIFT)
+
+static const char* kTransitionNames[SLIDE_TRANSITION_COUNT] = {
+    "none",
+    "crossfade",
+    "wipe",
+    "push",
+};
+
+// set from the console task, read by the LVGL task once per transition
+static volatile SlideTransitionType type_ = SLIDE_TRANSITION_DEFAULT;
+static volatile uint32_t duration_ms_ = SLIDE_TRANSITION_DEFAULT_MS;
+static SlideTransitionStats stats_;
+
+void InitializeSlideTransition() {
+  int32_t type = ParameterGetSlideTransition(SLIDE_TRANSITION_DEFAULT);
+  int32_t duration_ms = ParameterGetSlideTransitionMs(SLIDE_TRANSITION_DEFAULT_MS);
+  if (type < 0 || type >= SLIDE_TRANSITION_COUNT) type = SLIDE_TRANSITION_DEFAULT;
+  if (duration_ms < 0 || duration_ms > SLIDE_TRANSITION_MAX_MS) {
+    duration_ms = SLIDE_TRANSITION_DEFAULT_MS;
+  }
+  type_ = (SlideTransitionType)type;
+  duration_ms_ = duration_ms;
+  if (type_ != SLIDE_TRANSITION_NONE) DisplayReserveDirectDraw();
+  ESP_LOGI(TAG, "%s, %d ms", kTransitionNames[type_], (int)duration_ms_);
+}
+
+const char* SlideTransitionName(SlideTransitionType type) {
+  if (type < 0 || type >= SLIDE_TRANSITION_COUNT) return "?";
+  return kTransitionNames[type];
+}
+
+SlideTransitionType SlideTransitionFromName(const char* name) {
+  for (int i = 0; i < SLIDE_TRANSITION_COUNT; i++) {
+    if (strcmp(name, kTransitionNames[i]) == 0) return (SlideTransitionType)i;
+  }
+  return SLIDE_TRANSITION_COUNT;
+}
+
+SlideTransitionType GetSlideTransition() { return type_; }
+
+uint32_t GetSlideTransitionMs() { return duration_ms_; }
+
+bool SetSlideTransition(SlideTransitionType type, uint32_t duration_ms) {
+  if (type < 0 || type >= SLIDE_TRANSITION_COUNT || duration_ms > SLIDE_TRANSITION_MAX_MS) {
+    return false;
+  }
+  if (type != SLIDE_TRANSITION_NONE && !DisplayReserveDirectDraw()) return false;
+  if (type != type_) ParameterSetSlideTransition(type);
+  if (duration_ms != duration_ms_) ParameterSetSlideTransitionMs(duration_ms);
+  type_ = type;
+  duration_ms_ = duration_ms;
+  return true;
+}
+
+void GetSlideTransitionStats(SlideTransitionStats* stats) { *stats = stats_; }
+
+// the frames hold two RGB565 pixels per 32 bit word, byte swapped for the panel when
+// LV_COLOR_16_SWAP is set. blending works on native order pixels.
+static inline uint32_t SwapPixelPair(uint32_t pair) {
+#if LV_COLOR_16_SWAP
+  return ((pair & 0x00ff00ffu) << 8) | ((pair >> 8) & 0x00ff00ffu);
+#else
+  return pair;
+#endif
+}
+
+static inline uint32_t Blend565(uint32_t a, uint32_t b, uint32_t weight) {
+  return Pack565(Lerp565(Spread565(a), Spread565(b), weight));
+}
+
+// blends a row two pixels at a time, weight 0 is all `from`, 32 all `to`
+static void CrossfadeRow(uint16_t* dst, const uint16_t* from, const uint16_t* to, int width,
+                         uint32_t weight) {
+  uint32_t* dst_pairs = (uint32_t*)dst;
+  const uint32_t* from_pairs = (const uint32_t*)from;
+  const uint32_t* to_pairs = (const uint32_t*)to;
+  for (int i = 0; i < width / 2; i++) {
+    uint32_t a = SwapPixelPair(from_pairs[i]), b = SwapPixelPair(to_pairs[i]);
+    uint32_t lo = Blend565(a & 0xffff, b & 0xffff, weight);
+    uint32_t hi = Blend565(a >> 16, b >> 16, weight);
+    dst_pairs[i] = SwapPixelPair(lo | (hi << 16));
+  }
+}
+
+// composes one row of the transition at the given (eased) progress
+static void ComposeRow(SlideTransitionType type, uint16_t* dst, const uint16_t* from,
+                       const uint16_t* to, uint32_t progress) {
+  const int width = EXAMPLE_LCD_H_RES;
+  int edge = (width * progress) >> PROGRESS_SHIFT;
+  switch (type) {
+    case SLIDE_TRANSITION_CROSSFADE: {
+      uint32_t weight = progress >> (PROGRESS_SHIFT - 5);
+      if (weight == 0) {
+        memcpy(dst, from, width * 2);
+      } else if (weight >= 32) {
+        memcpy(dst, to, width * 2);
+      } else {
+        CrossfadeRow(dst, from, to, width, weight);
+      }
+      break;
+    }
+    case SLIDE_TRANSITION_WIPE:
+      memcpy(dst, to, edge * 2);
+      memcpy(dst + edge, from + edge, (width - edge) * 2);
+      break;
+    case SLIDE_TRANSITION_PUSH:
+      memcpy(dst, from + edge, (width - edge) * 2);
+      memcpy(dst + width - edge, to, edge * 2);
+      break;
+    default:
+      memcpy(dst, to, width * 2);
+      break;
+  }
+}
+
+static bool DrawTransitionFrame(SlideTransitionType type, const uint16_t* from,
+                                const uint16_t* to, uint32_t progress) {
+  for (int y = 0; y < EXAMPLE_LCD_V_RES; y += DISPLAY_DIRECT_STRIP_LINES) {
+    int lines = EXAMPLE_LCD_V_RES - y;
+    if (lines > DISPLAY_DIRECT_STRIP_LINES) lines = DISPLAY_DIRECT_STRIP_LINES;
+    uint16_t* strip = DisplayNextStrip();
+    if (strip == NULL) return false;
+    for (int row = 0; row < lines; row++) {
+      int offset = (y + row) * EXAMPLE_LCD_H_RES;
+      ComposeRow(type, strip + row * EXAMPLE_LCD_H_RES, from + offset, to + offset, progress);
+    }
+    if (!DisplaySendStrip(0, y, EXAMPLE_LCD_H_RES, lines)) return false;
+  }
+  return true;
+}
+
+// smoothstep, slow at both ends
+static uint32_t EaseInOut(uint32_t progress) {
+  uint64_t p = progress;
+  return (uint32_t)((p * p * (3 * PROGRESS_ONE - 2 * p)) >> (2 * PROGRESS_SHIFT));
+}
+
+// the transition that plays, LVGL side only
+static const uint16_t* from_ = NULL;
+static const uint16_t* to_ = NULL;
+static SlideTransitionType playing_type_ = SLIDE_TRANSITION_NONE;
+static int64_t playing_duration_us_ = 0;
+static int64_t start_us_ = 0;
+static uint32_t frames_ = 0;
+static uint32_t max_frame_us_ = 0;
+
+bool SlideTransitionStart(const uint16_t* from, const uint16_t* to) {
+  SlideTransitionType type = type_;
+  int64_t duration_us = (int64_t)duration_ms_ * 1000;
+  if (type == SLIDE_TRANSITION_NONE || duration_us == 0 || from == NULL || to == NULL) {
+    return false;
+  }
+  from_ = from;
+  to_ = to;
+  playing_type_ = type;
+  playing_duration_us_ = duration_us;
+  start_us_ = esp_timer_get_time();
+  frames_ = 0;
+  max_frame_us_ = 0;
+  return true;
+}
+
+bool SlideTransitionActive() { return playing_type_ != SLIDE_TRANSITION_NONE; }
+
+SlideTransitionTickResult SlideTransitionStep() {
+  if (playing_type_ == SLIDE_TRANSITION_NONE) return SLIDE_TRANSITION_TICK_IDLE;
+  SlideTransitionType type = playing_type_;
+
+  // the progress of every frame follows the clock, so a slow frame shortens the transition by
+  // a frame instead of stretching it
+  int64_t frame_start_us = esp_timer_get_time();
+  int64_t elapsed_us = frame_start_us - start_us_;
+  uint32_t progress = elapsed_us >= playing_duration_us_
+                          ? PROGRESS_ONE
+                          : (uint32_t)((elapsed_us << PROGRESS_SHIFT) / playing_duration_us_);
+  // one frame per tick, its strips are on the panel before LVGL may flush again
+  bool ok = DisplayBeginDirectDrawLocked();
+  ok = ok && DrawTransitionFrame(type, from_, to_, EaseInOut(progress));
+  DisplayEndDirectDraw();
+  uint32_t frame_us = esp_timer_get_time() - frame_start_us;
+  if (frame_us > max_frame_us_) max_frame_us_ = frame_us;
+  frames_++;
+  if (ok && progress < PROGRESS_ONE) return SLIDE_TRANSITION_TICK_FRAME;
+
+  playing_type_ = SLIDE_TRANSITION_NONE;
+  from_ = to_ = NULL;
+  uint32_t total_us = esp_timer_get_time() - start_us_;
+  stats_.played++;
+  if ((uint64_t)frames_ * 1000000 < (uint64_t)SLIDE_TRANSITION_TARGET_FPS * total_us) {
+    stats_.slow++;
+  }
+  stats_.last_frames = frames_;
+  stats_.last_us = total_us;
+  stats_.last_max_frame_us = max_frame_us_;
+  ESP_LOGD(TAG, "%s: %d frames in %d ms, slowest %d ms", kTransitionNames[type], (int)frames_,
+           (int)(total_us / 1000), (int)(max_frame_us_ / 1000));
+  if (!ok) ESP_LOGE(TAG, "panel write failed during the %s", kTransitionNames[type]);
+  return ok ? SLIDE_TRANSITION_TICK_DONE : SLIDE_TRANSITION_TICK_FAILED;
+}
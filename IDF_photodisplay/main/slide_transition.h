@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// slide transitions, played straight to the panel from the outgoing and the incoming full
+// screen frames. every step is composed strip by strip into the direct draw strip buffers, so
+// the next strip is blended while the panel DMA sends the one before.
+typedef enum {
+  SLIDE_TRANSITION_NONE = 0,   // hard cut, LVGL redraws the new photo
+  SLIDE_TRANSITION_CROSSFADE,  // alpha blend of the two photos
+  SLIDE_TRANSITION_WIPE,       // the new photo is uncovered from the left edge
+  SLIDE_TRANSITION_PUSH,       // the new photo slides in from the right and pushes the old out
+  SLIDE_TRANSITION_COUNT,
+} SlideTransitionType;
+
+// defaults until changed from the console, the setting is kept in NVS
+#define SLIDE_TRANSITION_DEFAULT SLIDE_TRANSITION_CROSSFADE
+#define SLIDE_TRANSITION_DEFAULT_MS 400
+#define SLIDE_TRANSITION_MAX_MS 2000
+// one frame is drawn per LVGL timer tick of this period, LVGL runs in between
+#define SLIDE_TRANSITION_TICK_MS 10
+// transitions that run below this are counted as slow
+#define SLIDE_TRANSITION_TARGET_FPS 30
+
+typedef struct {
+  uint32_t played;             // transitions played so far
+  uint32_t slow;               // of those, the ones below SLIDE_TRANSITION_TARGET_FPS
+  uint32_t last_frames;        // frames of the last transition
+  uint32_t last_us;            // duration of the last transition, including the last transfer
+  uint32_t last_max_frame_us;  // slowest frame of the last transition
+} SlideTransitionStats;
+
+typedef enum {
+  SLIDE_TRANSITION_TICK_IDLE = 0,  // no transition is playing
+  SLIDE_TRANSITION_TICK_FRAME,     // a frame was drawn, more follow
+  SLIDE_TRANSITION_TICK_DONE,      // the last frame was drawn, the panel shows the new photo
+  SLIDE_TRANSITION_TICK_FAILED,    // a panel write failed, the panel shows parts of both photos
+} SlideTransitionTickResult;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void InitializeSlideTransition();
+const char* SlideTransitionName(SlideTransitionType type);
+// returns SLIDE_TRANSITION_COUNT for an unknown name
+SlideTransitionType SlideTransitionFromName(const char* name);
+SlideTransitionType GetSlideTransition();
+uint32_t GetSlideTransitionMs();
+bool SetSlideTransition(SlideTransitionType type, uint32_t duration_ms);
+void GetSlideTransitionStats(SlideTransitionStats* stats);
+
+// starts the configured transition from one full screen frame to the other, both have to stay
+// untouched until it ends. returns false if there is nothing to play (no transition configured,
+// a NULL frame). LVGL side, lock held.
+bool SlideTransitionStart(const uint16_t* from, const uint16_t* to);
+bool SlideTransitionActive();
+// LVGL side, lock held: called every SLIDE_TRANSITION_TICK_MS from an LVGL timer, draws the
+// frame that is due by the clock
+SlideTransitionTickResult SlideTransitionStep();
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,19 +2,23 @@
 """
 batch_center_crop.py
 Usage:
-    python IDF_photodisplay/tools/batch_center_crop.py  data/photodisplay/raw  data/photodisplay/prod
+    python IDF_photodisplay/tools/batch_center_crop.py  data/photodisplay/raw  data/photodisplay/prod  [jpg|qoi|device] [kenburns]
 """
 
 import os
 import sys
 from glob import iglob
 from PIL import Image
+from qoi_encode import save_qoi
+from device_profile import save_device_jpeg, format_report
 
 # ----------------- 参数 -----------------
 SRC_EXT = ("*.jpg", "*.jpeg")          # 可扩展更多
 CROP_W, CROP_H = 368, 448              # 目标尺寸
 QUALITY = 95                           # 输出 JPEG 质量
 META_NAME = "meta.txt"                 # 新增：meta 文件名
+OUTPUT_FORMAT = "jpg"                  # 输出格式 jpg / qoi（qoi 解码快很多，文件更大）/ device（按设备解码速度调参的 jpg）
+KEN_BURNS_SCALE = 1.5                  # kenburns 模式：裁剪为目标尺寸的 1.5 倍，设备端平移缩放显示（需 IMAGE_LOADER_KEN_BURNS，不超过 KEN_BURNS_MAX_*）
 # ---------------------------------------
 
 def center_crop_368_448(src_dir: str, dst_dir: str):
@@ -54,13 +58,22 @@ def center_crop_368_448(src_dir: str, dst_dir: str):
                 rel_path = os.path.relpath(img_path, src_dir)
                 save_path = os.path.join(dst_dir, rel_path)
                 os.makedirs(os.path.dirname(save_path), exist_ok=True)
-                im.save(save_path, "JPEG", quality=QUALITY)
+                if OUTPUT_FORMAT == "qoi":
+                    rel_path = os.path.splitext(rel_path)[0] + ".qoi"
+                    save_path = os.path.splitext(save_path)[0] + ".qoi"
+                    save_qoi(im, save_path)
+                elif OUTPUT_FORMAT == "device":
+                    report = save_device_jpeg(im, save_path)
+                else:
+                    im.save(save_path, "JPEG", quality=QUALITY)
 
                 # 收集相对路径（去掉最前面的 ./ 等）
                 rel_path_for_meta = os.path.normpath(rel_path)
                 meta_list.append(rel_path_for_meta)
 
                 print(f"[{idx:>4}/{len(src_imgs)}]  {img_path}  ->  {save_path}")
+                if OUTPUT_FORMAT == "device":
+                    print(f"        {format_report(report)}")
 
         except Exception as e:
             print(f"!! 处理失败：{img_path}  原因：{e}", file=sys.stderr)
@@ -73,9 +86,15 @@ def center_crop_368_448(src_dir: str, dst_dir: str):
 
 
 if __name__ == "__main__":
-    if len(sys.argv) != 3:
-        print("用法: python batch_center_crop.py  <源文件夹>  <目标文件夹>")
+    options = sys.argv[3:]
+    if "kenburns" in options:
+        options.remove("kenburns")
+        CROP_W, CROP_H = int(CROP_W * KEN_BURNS_SCALE), int(CROP_H * KEN_BURNS_SCALE)
+    if len(sys.argv) < 3 or options not in ([], ["jpg"], ["qoi"], ["device"]):
+        print("用法: python batch_center_crop.py  <源文件夹>  <目标文件夹>  [jpg|qoi|device] [kenburns]")
         sys.exit(1)
+    if options:
+        OUTPUT_FORMAT = options[0]
 
     src_folder, dst_folder = sys.argv[1], sys.argv[2]
     center_crop_368_448(src_folder, dst_folder)
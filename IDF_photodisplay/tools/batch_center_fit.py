@@ -2,19 +2,22 @@
 """
 batch_center_crop.py
 Usage:
-    python IDF_photodisplay/tools/batch_center_fit.py  data/photodisplay/raw  data/photodisplay/prod
+    python IDF_photodisplay/tools/batch_center_fit.py  data/photodisplay/raw  data/photodisplay/prod  [jpg|qoi|device]
 """
 
 import os
 import sys
 from glob import iglob
 from PIL import Image
+from qoi_encode import save_qoi
+from device_profile import save_device_jpeg, format_report
 
 # ----------------- 参数 -----------------
 SRC_EXT = ("*.jpg", "*.jpeg")          # 可扩展更多
 TARGET_W, TARGET_H = 368, 448          # 目标画框
 QUALITY = 95                           # 输出 JPEG 质量
 META_NAME = "meta.txt"                 # 新增：meta 文件名
+OUTPUT_FORMAT = "jpg"                  # 输出格式 jpg / qoi（qoi 解码快很多，文件更大）/ device（按设备解码速度调参的 jpg）
 # ---------------------------------------
 
 def best_fit_368_448(im: Image.Image) -> Image.Image:
@@ -61,10 +64,19 @@ def process_folder(src_dir: str, dst_dir: str):
                 rel_path = os.path.relpath(img_path, src_dir)
                 save_path = os.path.join(dst_dir, rel_path)
                 os.makedirs(os.path.dirname(save_path), exist_ok=True)
-                im.save(save_path, "JPEG", quality=QUALITY)
+                if OUTPUT_FORMAT == "qoi":
+                    rel_path = os.path.splitext(rel_path)[0] + ".qoi"
+                    save_path = os.path.splitext(save_path)[0] + ".qoi"
+                    save_qoi(im, save_path)
+                elif OUTPUT_FORMAT == "device":
+                    report = save_device_jpeg(im, save_path)
+                else:
+                    im.save(save_path, "JPEG", quality=QUALITY)
 
                 meta_list.append(os.path.normpath(rel_path))
                 print(f"[{idx:>4}/{len(src_imgs)}]  {img_path}  ->  {save_path}")
+                if OUTPUT_FORMAT == "device":
+                    print(f"        {format_report(report)}")
 
         except Exception as e:
             print(f"!! 处理失败：{img_path}  原因：{e}", file=sys.stderr)
@@ -77,7 +89,9 @@ def process_folder(src_dir: str, dst_dir: str):
 
 
 if __name__ == "__main__":
-    if len(sys.argv) != 3:
-        print("用法: python batch_best_fit.py  <源文件夹>  <目标文件夹>")
+    if len(sys.argv) not in (3, 4) or sys.argv[3:] not in ([], ["jpg"], ["qoi"], ["device"]):
+        print("用法: python batch_best_fit.py  <源文件夹>  <目标文件夹>  [jpg|qoi|device]")
         sys.exit(1)
+    if len(sys.argv) == 4:
+        OUTPUT_FORMAT = sys.argv[3]
     process_folder(sys.argv[1], sys.argv[2])
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+device_profile.py
+按设备（ESP32-S3 + JPEGDEC）解码速度保存 JPEG，供 batch 脚本的 device 模式使用：
+  - baseline（非 progressive，JPEGDEC 对 progressive 只能解 DC）
+  - 4:2:0 采样，走 s3_simd_420.S
+  - 每个 MCU 行一个 restart marker（DRI），固件可以在中间切开双核解码
+  - 文件大小不超过固件的 jpg 缓冲区（JPG_FILE_BUFFER_SIZE），超了就逐步降低质量
+并估算每个文件在设备上的解码耗时。
+Usage:
+    python IDF_photodisplay/tools/device_profile.py  a.jpg  b.jpg ...      # 只分析已有文件
+"""
+
+import io
+import os
+import struct
+import sys
+
+QUALITY_START = 95                     # 起始质量
+QUALITY_MIN = 80                       # 最低质量，再低肉眼可见
+QUALITY_STEP = 3
+SIZE_CAP = 190 * 1000                  # 固件 JPG_FILE_BUFFER_SIZE 为 200000，留点余量
+
+# 解码耗时模型（毫秒）：Huffman 与文件字节数成正比，IDCT / 颜色转换与像素数成正比。
+# 系数是 240MHz S3 上 JPEGDEC 的粗略值，可用固件日志里 DECODER 的 avg 校准。
+COST_US_PER_BYTE = 0.25
+COST_US_PER_PIXEL = {"4:2:0": 0.10, "4:2:2": 0.13, "4:4:4": 0.16, "gray": 0.06}
+COST_US_PROGRESSIVE_FACTOR = 3.0       # progressive 在设备上需要整图缓存 + 多次扫描
+
+
+def jpeg_info(data: bytes) -> dict:
+    """解析 JPEG 头：尺寸、采样、是否 progressive、restart interval"""
+    info = {"width": 0, "height": 0, "subsampling": "?", "progressive": False, "restart": 0}
+    pos = 2
+    while pos + 4 <= len(data):
+        if data[pos] != 0xFF:
+            break
+        marker = data[pos + 1]
+        if marker == 0xFF:
+            pos += 1
+            continue
+        length = struct.unpack(">H", data[pos + 2:pos + 4])[0]
+        seg = data[pos + 4:pos + 2 + length]
+        if marker in (0xC0, 0xC1, 0xC2):
+            info["progressive"] = marker == 0xC2
+            info["height"], info["width"] = struct.unpack(">HH", seg[1:5])
+            comps = seg[5]
+            if comps == 1:
+                info["subsampling"] = "gray"
+            else:
+                h, v = seg[7] >> 4, seg[7] & 0x0F
+                info["subsampling"] = {(2, 2): "4:2:0", (2, 1): "4:2:2", (1, 1): "4:4:4"}.get((h, v), f"{h}x{v}")
+        elif marker == 0xDD:
+            info["restart"] = struct.unpack(">H", seg[0:2])[0]
+        elif marker == 0xDA:
+            break
+        pos += 2 + length
+    return info
+
+
+def predict_decode_ms(data: bytes) -> dict:
+    """返回单核和双核（有 DRI 时）的预估解码耗时"""
+    info = jpeg_info(data)
+    pixels = info["width"] * info["height"]
+    us = len(data) * COST_US_PER_BYTE + pixels * COST_US_PER_PIXEL.get(info["subsampling"], 0.16)
+    if info["progressive"]:
+        us *= COST_US_PROGRESSIVE_FACTOR
+    single = us / 1000
+    # 固件只对 baseline + DRI 的文件双核解码，两半各一个核
+    dual = single / 2 if info["restart"] and not info["progressive"] else single
+    return {"single_ms": single, "dual_ms": dual, **info}
+
+
+def encode_device_jpeg(im, quality: int) -> bytes:
+    buf = io.BytesIO()
+    # restart_marker_rows 需要 Pillow >= 10.2，旧版本会忽略，报告里 DRI 显示为 0
+    im.save(buf, "JPEG", quality=quality, subsampling="4:2:0", progressive=False,
+            optimize=True, restart_marker_rows=1)
+    return buf.getvalue()
+
+
+def save_device_jpeg(im, path: str) -> dict:
+    """按设备配置保存，返回预估结果（含最终质量和文件大小）"""
+    im = im.convert("RGB")
+    quality = QUALITY_START
+    data = encode_device_jpeg(im, quality)
+    while len(data) > SIZE_CAP and quality - QUALITY_STEP >= QUALITY_MIN:
+        quality -= QUALITY_STEP
+        data = encode_device_jpeg(im, quality)
+    with open(path, "wb") as f:
+        f.write(data)
+    report = predict_decode_ms(data)
+    report.update(quality=quality, size=len(data), over_cap=len(data) > SIZE_CAP)
+    return report
+
+
+def format_report(report: dict) -> str:
+    line = f"q{report['quality']}  " if "quality" in report else ""
+    line += (f"{report['size'] / 1000:.0f}KB  {report['subsampling']}  DRI {report['restart']}"
+             f"  预估解码 {report['single_ms']:.0f}ms (双核 {report['dual_ms']:.0f}ms)")
+    if report.get("over_cap"):
+        line += "  !! 超过固件缓冲区，只能流式单核解码"
+    if report["progressive"]:
+        line += "  !! progressive"
+    return line
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("用法: python device_profile.py  <jpg 文件> ...")
+        sys.exit(1)
+    for path in sys.argv[1:]:
+        with open(path, "rb") as f:
+            data = f.read()
+        report = predict_decode_ms(data)
+        report["size"] = len(data)
+        report["over_cap"] = len(data) > SIZE_CAP
+        print(f"{os.path.basename(path)}:  {format_report(report)}")
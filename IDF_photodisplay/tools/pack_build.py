@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""
+pack_build.py
+把 prod 目录里 meta.txt 列出的图片（jpg / qoi）打包成一个 photos.pak，固件打开一次、常驻，
+每张图只需一次定位读取，不再每张都做 FAT 查找 + fopen + fseek。格式见 main/photo_pack.h：
+  - 32 字节文件头
+  - 索引：每张图 20 字节（offset, length, crc32, width, height, format）
+  - 图片数据，每张从 512 字节（扇区）边界开始
+Usage:
+    python IDF_photodisplay/tools/pack_build.py  data/photodisplay/prod  [photos.pak]
+    # 不给输出路径时写到 prod/photos.pak，拷到 SD 卡 /prod/ 下即可
+"""
+
+import os
+import struct
+import sys
+import zlib
+from PIL import Image
+
+# ----------------- 与 main/photo_pack.h 保持一致 -----------------
+PACK_MAGIC = 0x4B415050                # "PPAK"
+PACK_VERSION = 1
+HEADER_SIZE = 32
+ENTRY_FORMAT = "<IIIHHB3x"             # offset, length, checksum, width, height, format
+ENTRY_SIZE = struct.calcsize(ENTRY_FORMAT)
+ALIGNMENT = 512
+MAX_ENTRIES = 65535                    # 固件里图片 id 是 16 位
+FORMAT_JPG, FORMAT_QOI = 0, 1
+META_NAME = "meta.txt"
+PACK_NAME = "photos.pak"
+# ---------------------------------------------------------------
+
+
+def image_info(path: str, data: bytes):
+    """返回 (format, width, height)，宽高为文件里存的方向（EXIF 旋转前）"""
+    if data[:4] == b"qoif":
+        width, height = struct.unpack(">II", data[4:12])
+        return FORMAT_QOI, width, height
+    with Image.open(path) as im:
+        if im.format != "JPEG":
+            raise ValueError(f"不支持的格式 {im.format}")
+        width, height = im.size
+    return FORMAT_JPG, width, height
+
+
+def align(offset: int) -> int:
+    return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+
+def read_meta(prod_dir: str):
+    meta_path = os.path.join(prod_dir, META_NAME)
+    with open(meta_path, encoding="utf-8") as f:
+        return [line.strip() for line in f if line.strip()]
+
+
+def build_pack(prod_dir: str, pack_path: str):
+    names = read_meta(prod_dir)
+    if len(names) > MAX_ENTRIES:
+        print(f"!! 图片太多（{len(names)}），最多 {MAX_ENTRIES} 张，多出的不打包", file=sys.stderr)
+        names = names[:MAX_ENTRIES]
+
+    photos = []
+    for idx, name in enumerate(names, 1):
+        path = os.path.join(prod_dir, name)
+        try:
+            with open(path, "rb") as f:
+                data = f.read()
+            fmt, width, height = image_info(path, data)
+            if width > 0xFFFF or height > 0xFFFF:
+                raise ValueError(f"尺寸 {width}x{height} 太大")
+            photos.append((data, fmt, width, height))
+            print(f"[{idx:>5}/{len(names)}]  {name}  {width}x{height}  {len(data)} B")
+        except Exception as e:
+            # 跳过的图不进索引，固件里的图片 id 就是在 pack 里的序号
+            print(f"!! 跳过：{path}  原因：{e}", file=sys.stderr)
+    if not photos:
+        print("没有可打包的图片", file=sys.stderr)
+        sys.exit(1)
+
+    # 先排好每张图的位置，再写索引和数据
+    offset = align(HEADER_SIZE + ENTRY_SIZE * len(photos))
+    index = bytearray()
+    for data, fmt, width, height in photos:
+        if offset + len(data) > 0xFFFFFFFF:
+            print("!! pack 超过 4 GB", file=sys.stderr)
+            sys.exit(1)
+        index += struct.pack(ENTRY_FORMAT, offset, len(data), zlib.crc32(data), width, height, fmt)
+        offset = align(offset + len(data))
+
+    header = struct.pack("<IHHIHHI12x", PACK_MAGIC, PACK_VERSION, HEADER_SIZE, len(photos),
+                         ENTRY_SIZE, 0, zlib.crc32(index))
+    assert len(header) == HEADER_SIZE
+
+    tmp_path = pack_path + ".tmp"
+    with open(tmp_path, "wb") as f:
+        f.write(header)
+        f.write(index)
+        for data, *_ in photos:
+            f.write(b"\0" * (align(f.tell()) - f.tell()))
+            f.write(data)
+    # 写完再替换，拷卡时不会拿到半个 pack
+    os.replace(tmp_path, pack_path)
+    print(f"\nPack 已生成：{pack_path}  共 {len(photos)} 张  {os.path.getsize(pack_path)} B")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (2, 3):
+        print("用法: python pack_build.py  <prod 文件夹>  [输出 .pak]")
+        sys.exit(1)
+    prod = sys.argv[1]
+    build_pack(prod, sys.argv[2] if len(sys.argv) == 3 else os.path.join(prod, PACK_NAME))
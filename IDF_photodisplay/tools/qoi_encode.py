@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""
+qoi_encode.py
+把图片编码成 QOI (https://qoiformat.org)，供 batch 脚本输出 .qoi 使用。
+QOI 解码只有字节操作，比 JPEG 的 Huffman 解码快很多，代价是文件更大（SD 卡空间够用）。
+Usage:
+    python IDF_photodisplay/tools/qoi_encode.py  in.jpg  out.qoi
+"""
+
+import struct
+import sys
+
+QOI_OP_INDEX = 0x00
+QOI_OP_DIFF = 0x40
+QOI_OP_LUMA = 0x80
+QOI_OP_RUN = 0xC0
+QOI_OP_RGB = 0xFE
+QOI_END = b"\x00" * 7 + b"\x01"
+
+# 屏幕是 RGB565，先把低位清掉：显示效果不变，游程 / 差分更多，文件更小
+MASK_5 = bytes(v & 0xF8 for v in range(256))
+MASK_6 = bytes(v & 0xFC for v in range(256))
+
+
+def quantize_rgb565(data: bytes) -> bytes:
+    out = bytearray(data)
+    out[0::3] = data[0::3].translate(MASK_5)
+    out[1::3] = data[1::3].translate(MASK_6)
+    out[2::3] = data[2::3].translate(MASK_5)
+    return bytes(out)
+
+
+def encode_rgb(data: bytes, width: int, height: int) -> bytes:
+    """data 为 RGB888 逐行排列"""
+    out = bytearray(struct.pack(">4sIIBB", b"qoif", width, height, 3, 0))
+    index = [None] * 64
+    pr, pg, pb = 0, 0, 0
+    run = 0
+    for i in range(0, width * height * 3, 3):
+        r, g, b = data[i], data[i + 1], data[i + 2]
+        if r == pr and g == pg and b == pb:
+            run += 1
+            if run == 62:
+                out.append(QOI_OP_RUN | (run - 1))
+                run = 0
+            continue
+        if run:
+            out.append(QOI_OP_RUN | (run - 1))
+            run = 0
+
+        h = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64
+        if index[h] == (r, g, b):
+            out.append(QOI_OP_INDEX | h)
+        else:
+            index[h] = (r, g, b)
+            dr = (r - pr + 128) % 256 - 128
+            dg = (g - pg + 128) % 256 - 128
+            db = (b - pb + 128) % 256 - 128
+            dr_dg, db_dg = dr - dg, db - dg
+            if -2 <= dr <= 1 and -2 <= dg <= 1 and -2 <= db <= 1:
+                out.append(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2))
+            elif -32 <= dg <= 31 and -8 <= dr_dg <= 7 and -8 <= db_dg <= 7:
+                out.append(QOI_OP_LUMA | (dg + 32))
+                out.append((dr_dg + 8) << 4 | (db_dg + 8))
+            else:
+                out += bytes((QOI_OP_RGB, r, g, b))
+        pr, pg, pb = r, g, b
+
+    if run:
+        out.append(QOI_OP_RUN | (run - 1))
+    out += QOI_END
+    return bytes(out)
+
+
+def save_qoi(im, path: str):
+    """im 为 PIL.Image"""
+    im = im.convert("RGB")
+    w, h = im.size
+    with open(path, "wb") as f:
+        f.write(encode_rgb(quantize_rgb565(im.tobytes()), w, h))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print("用法: python qoi_encode.py  <输入图片>  <输出 .qoi>")
+        sys.exit(1)
+    from PIL import Image
+    with Image.open(sys.argv[1]) as im:
+        save_qoi(im, sys.argv[2])
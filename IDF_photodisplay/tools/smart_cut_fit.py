@@ -2,13 +2,15 @@
 """
 smart_crop_fit.py
 Usage:
-    python IDF_photodisplay/tools/smart_cut_fit.py  data/photodisplay/raw  data/photodisplay/prod
+    python IDF_photodisplay/tools/smart_cut_fit.py  data/photodisplay/raw  data/photodisplay/prod  [jpg|qoi|device]
 """
 
 import os
 import sys
 from glob import iglob
 from PIL import Image, ImageDraw
+from qoi_encode import save_qoi
+from device_profile import save_device_jpeg, format_report
 from ultralytics import YOLO
 import pyzipper
 from pillow_heif import HeifImagePlugin   # 注册 HEIC 解码
@@ -22,6 +24,7 @@ TARGET_W, TARGET_H = 368, 448
 CROP_W, CROP_H = 368, 448
 QUALITY = 95
 META_NAME = "meta.txt"
+OUTPUT_FORMAT = "jpg"  # jpg / qoi / device
 DRAW_DEBUG = False
 
 
@@ -221,10 +224,19 @@ def process_folder(src_dir: str, dst_dir: str):
                 rel_path = os.path.relpath(img_path, src_dir).replace(" ", "_")
                 save_path = os.path.join(dst_dir, rel_path)
                 os.makedirs(os.path.dirname(save_path), exist_ok=True)
-                im.save(save_path, "JPEG", quality=QUALITY)
+                if OUTPUT_FORMAT == "qoi":
+                    rel_path = os.path.splitext(rel_path)[0] + ".qoi"
+                    save_path = os.path.splitext(save_path)[0] + ".qoi"
+                    save_qoi(im, save_path)
+                elif OUTPUT_FORMAT == "device":
+                    report = save_device_jpeg(im, save_path)
+                else:
+                    im.save(save_path, "JPEG", quality=QUALITY)
 
                 meta_list.append(os.path.normpath(rel_path))
                 print(f"[{idx:>4}/{len(src_imgs)}]  {img_path}  ->  {save_path}")
+                if OUTPUT_FORMAT == "device":
+                    print(f"        {format_report(report)}")
 
         except Exception as e:
             print(f"!! 处理失败：{img_path}  原因：{e}", file=sys.stderr)
@@ -236,7 +248,9 @@ def process_folder(src_dir: str, dst_dir: str):
 
 
 if __name__ == "__main__":
-    if len(sys.argv) != 3:
-        print("用法: python smart_crop_fit.py  <源文件夹>  <目标文件夹>")
+    if len(sys.argv) not in (3, 4) or sys.argv[3:] not in ([], ["jpg"], ["qoi"], ["device"]):
+        print("用法: python smart_crop_fit.py  <源文件夹>  <目标文件夹>  [jpg|qoi|device]")
         sys.exit(1)
+    if len(sys.argv) == 4:
+        OUTPUT_FORMAT = sys.argv[3]
     process_folder(sys.argv[1], sys.argv[2])